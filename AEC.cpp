@@ -21,1752 +21,6647 @@
 #include <algorithm>
 #include <unordered_map>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <ctime>
+#include <cstdint>
+#include <cstring>
+#include <bitset>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string_view>
+#include <condition_variable>
+#include <sstream>
+#include <poll.h>
+#include <csignal>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "AEC.h"
 
-void fileReader(std::string, std::string, int);
+/***************************************************************************
+ * How control leaves an instruction. Used by the register dataflow engine
+ * to connect basic blocks together. */
+enum Flow
+{
+    FLOW_NEXT,          // Falls through to the next instruction
+    FLOW_BRANCH,        // b label, never falls through
+    FLOW_COND_BRANCH,   // beq label, can jump or fall through
+    FLOW_RETURN         // bx lr, mov pc, lr or pop {pc}
+};
 
-/*************************************************************************
- * main takes the command line given by the user and calls filereader
- * based on the commands given in the command line. */
-int main(int argc, char* argv[]) {
-    // Before ANYTHING is done, we check that we have correct input
-    // Format for command is AEC <filename> <command> or AEC <directory> -t
-    if (argc != 3) 
+/***************************************************************************
+ * The addressing mode of a load or store, decoded from its operands. */
+enum AddressMode : uint8_t
+{
+    MODE_NONE,              // Not a load or store
+    MODE_INDIRECT,          // [r1]
+    MODE_INDIRECT_OFFSET,   // [r1, #4], [r1, r2] or [r1, r2, lsl #2]
+    MODE_PRE_INDEX,         // [r1, #4]!
+    MODE_POST_INDEX,        // [r1], #4
+    MODE_PC_RELATIVE,       // [pc, #8] or a label
+    MODE_PC_LITERAL,        // =value, from the literal pool
+    MODE_UNSURE,            // Operands that don't make an address
+    MODE_COUNT
+};
+
+const char* const addressModeNames[MODE_COUNT] = {
+    "", "indirect addressing", "indirect addressing with offset", "auto, pre-index addressing",
+    "auto, post-index addressing", "PC relative addressing", "PC relative addressing with literal pool",
+    "uncertain addressing modes"};
+
+/***************************************************************************
+ * One entry per instruction, filled in while the line is tokenized. The
+ * masks hold one bit per register, r0-r15 or x0-x30 and sp, so whole
+ * register sets can be handled at once by the dataflow engine. */
+struct Instruction
+{
+    int line = 0;
+    uint32_t useMask = 0;       // Registers read by the instruction
+    uint32_t argumentMask = 0;  // Registers that may be read by a call or push, never reported
+    uint32_t defMask = 0;       // Registers loaded with a value
+    uint32_t clobberMask = 0;   // Registers wiped without a value, like after printf
+    bool conditional = false;   // Conditional instructions may not load their register
+    bool restore = false;       // pop restores saved values so it is never a dead store
+    bool call = false;          // bl and blx
+    AddressMode mode = MODE_NONE;
+    int stackDelta = 0;         // Registers pushed, negative for pops
+    Flow flow = FLOW_NEXT;
+    std::string target;         // Label a branch jumps to
+    std::string op;             // The operator and operands, only kept for the binary IR
+    std::vector<std::string> operands;
+};
+
+/***************************************************************************
+ * A run of instructions that can only be entered at the top and left at
+ * the bottom. Each block keeps register masks for the analysis. */
+struct BasicBlock
+{
+    size_t first = 0, last = 0;     // Instruction indexes, inclusive
+    std::vector<size_t> successors, predecessors;
+    bool entry = false;
+    uint32_t entryMask = 0;         // Registers already loaded when entered from outside
+    uint32_t gen = 0, kill = 0;     // Reaching definitions transfer
+    uint32_t use = 0, def = 0;      // Liveness transfer
+    uint32_t in = 0, out = 0;       // Registers loaded on every path
+    uint32_t liveIn = 0, liveOut = 0;   // Registers read later on some path
+};
+
+/***************************************************************************
+ * The register facts the dataflow engine needs from an instruction set. */
+struct RegisterModel
+{
+    int registerCount = 16;             // Registers shown in the register use report
+    uint32_t alwaysLoaded = 0xE000;     // Registers that always hold a value
+    uint32_t returnLive = 0xFFF3;       // Registers the caller can still read after a return
+    uint32_t checked = 0x1FFF;          // Registers reported as used before load or dead
+    uint32_t argumentMask = 0x000F;     // Registers a subroutine is entered with
+};
+
+enum IsaProfile { ISA_DETECT, ISA_ARM32, ISA_THUMB, ISA_AARCH64 };
+
+/***************************************************************************
+ * Instruction set profiles. A profile is a set of static functions and
+ * constants describing one instruction set. analyzeLines is compiled once
+ * for each profile, so the line loop never has to ask which instruction
+ * set it is reading. Arm32 keeps the exact checks AEC has always made. */
+struct Arm32
+{
+    static constexpr IsaProfile profile = ISA_ARM32;
+    static constexpr int registerCount = 16;
+    static constexpr uint32_t alwaysLoaded = 0xE000;    // sp, lr and pc
+    static constexpr uint32_t returnLive = 0xFFF3;      // Everything but the scratch registers r2 and r3
+    static constexpr uint32_t checked = 0x1FFF;         // r0-r12
+    static constexpr uint32_t argumentMask = 0x000F;    // r0-r3
+    static constexpr uint32_t syscallMask = 0x00FF;     // r0-r7
+    static constexpr uint32_t stackPointerMask = 1u << 13;
+    static constexpr uint32_t linkRegisterMask = 1u << 14;
+    static constexpr uint32_t pcMask = 1u << 15;        // Loading the PC is a return
+
+    static uint32_t registerMask(const std::string&);
+    static int classifyOperator(const std::string&, Instruction&);
+    static int registerNumber(const std::string&);
+
+    static bool isRestricted(const std::string& token)
     {
-        std::cerr << "Correct formats: AEC <filename> <command> || AEC <directory> -t\n";
-        return -1;
+        static const std::unordered_set<std::string> restrictedRegisters = {
+            "r13", "r14", "r15", "R13", "R14", "R15"};
+        return restrictedRegisters.find(token) != restrictedRegisters.end();
+    }
+    static bool isUnwanted(const std::string& token)
+    {
+        static const std::unordered_set<std::string> unwantedOperators = {
+            "SWI", "LDM", "LTM", "swi", "ldm", "ltm"};
+        return unwantedOperators.find(token) != unwantedOperators.end();
+    }
+    // If the first character of an operator is a b then the operator is a branch
+    static bool isBranch(const std::string& token) { return token[0] == 'b' || token[0] == 'B'; }
+    static bool isCall(const std::string& token) { return token == "bl" || token == "BL"; }
+    static bool isRegisterBranch(const std::string& token) { return token == "bx" || token == "BX"; }
+    static bool isBareReturn(const std::string&) { return false; }
+    static bool isUnconditionalBranch(const std::string& token) { return token == "b" || token == "B"; }
+    // stmdb and stmfd with sp! push, ldm, ldmia and ldmfd with sp! pop, just like push and pop
+    static bool isPush(const std::string& token, const std::string& line)
+    {
+        return token.find("push") != std::string::npos || token.find("PUSH") != std::string::npos ||
+            (isMultiple(token, {"stmdb", "stmfd"}) && writesBackStack(line));
+    }
+    static bool isPop(const std::string& token, const std::string& line)
+    {
+        return token.find("pop") != std::string::npos || token.find("POP") != std::string::npos ||
+            (isMultiple(token, {"ldm", "ldmia", "ldmfd"}) && writesBackStack(line));
+    }
+    // Any other ldm loads its register list from the base register
+    static bool isLoadMultiple(const std::string& token)
+    {
+        return isMultiple(token, {"ldm", "ldmia", "ldmib", "ldmda", "ldmdb", "ldmfd", "ldmfa", "ldmed", "ldmea"});
     }
+    static bool isLinkRegister(const std::string& token) { return token == "lr" || token == "LR"; }
+    // Any list that holds lr saves it, like {lr}, {r4, lr} or {r4-r6, lr}
+    static bool savesLinkRegister(const std::string& token) { return (registerMask(token) & linkRegisterMask) != 0; }
 
-    std::string input_file = argv[1];
-    std::string output_file = "Reports/" + input_file.substr(0, input_file.find_last_of(".")) + "_report.txt";
-    std::string command = argv[2];
+    static bool isMultiple(const std::string&, std::initializer_list<const char*>);
+    static bool writesBackStack(const std::string& line)
+    {
+        return line.find("sp!") != std::string::npos || line.find("SP!") != std::string::npos;
+    }
+};
 
+/***************************************************************************
+ * Thumb shares the ARM registers and checks. It adds the compare and branch
+ * instructions cbz and cbnz, and IT blocks that only make the next
+ * instructions conditional. */
+struct Thumb : Arm32
+{
+    static constexpr IsaProfile profile = ISA_THUMB;
+    static int classifyOperator(const std::string&, Instruction&);
 
-    // Commands: -h help, -m print metrics to console, -e print errors to console
-    // -r print report, -t reads folder for all .s files and makes reports
-    // -c makes csv individual file -v reads a folder of .s files and makes csv files
-    switch(command[1]) 
+    static bool isBranch(const std::string& token)
     {
-        case 'h':
-            std::cout << "commands:\n";
-            std::cout << "  -h\t\tDisplay help message\n";
-            std::cout << "  -m\t\tPrint metrics to terminal\n";
-            std::cout << "  -e\t\tPrint errors to terminal\n";
-            std::cout << "  -r\t\tCreate report file\n";
-            std::cout << "  -c\t\tCreate csv file\n";
-            std::cout << "  <folder path> -t\t\tCreate report files from folder\n";
-            std::cout << "  <folder path> -v\t\tCreate csv files from folder\n";
+        return Arm32::isBranch(token) || token == "cbz" || token == "cbnz" || token == "CBZ" || token == "CBNZ";
+    }
+};
 
-            return 0;
+/***************************************************************************
+ * AArch64 has the registers x0-x30, with w0-w30 naming their low halves,
+ * and a separate sp. Subroutines return with ret, system calls take their
+ * number in x8, and the stack is saved with stp and ldp. */
+struct AArch64
+{
+    static constexpr IsaProfile profile = ISA_AARCH64;
+    static constexpr int registerCount = 31;
+    static constexpr uint32_t alwaysLoaded = 0xE0000000;    // fp, lr and sp
+    static constexpr uint32_t returnLive = 0xFFF80003;      // x0, x1 and the callee saved x19-x28
+    static constexpr uint32_t checked = 0x1FFFFFFF;         // x0-x28
+    static constexpr uint32_t argumentMask = 0x000000FF;    // x0-x7
+    static constexpr uint32_t syscallMask = 0x0000013F;     // x0-x5 and x8
+    static constexpr uint32_t stackPointerMask = 1u << 31;
+    static constexpr uint32_t pcMask = 0;                   // The PC can't be loaded directly
 
-        case 'm': // Print to console
-            fileReader(input_file, output_file, 1);
-            return 0;
+    static uint32_t registerMask(const std::string&);
+    static int classifyOperator(const std::string&, Instruction&);
+    static int registerNumber(const std::string&);
 
-        case 'e': // Print to console
-            fileReader(input_file, output_file, 2);
-            return 0;
+    static bool isRestricted(const std::string& token) { return token == "x30" || token == "X30"; }
+    static bool isUnwanted(const std::string&) { return false; }
+    static bool isBranch(const std::string& token)
+    {
+        return token[0] == 'b' || token[0] == 'B' || token == "ret" || token == "RET" || token == "cbz" ||
+            token == "cbnz" || token == "tbz" || token == "tbnz" || token == "CBZ" || token == "CBNZ" ||
+            token == "TBZ" || token == "TBNZ";
+    }
+    static bool isCall(const std::string& token) { return token == "bl" || token == "BL" || token == "blr" || token == "BLR"; }
+    static bool isRegisterBranch(const std::string&) { return false; }
+    static bool isBareReturn(const std::string& token) { return token == "ret" || token == "RET"; }
+    static bool isUnconditionalBranch(const std::string& token)
+    {
+        return token == "b" || token == "B" || token == "br" || token == "BR";
+    }
+    // stp with a pre-index writeback to sp pushes, ldp with a post-index from sp pops
+    static bool isPush(const std::string& token, const std::string& line)
+    {
+        return (token == "stp" || token == "STP") && line.find("[sp") != std::string::npos && line.find('!') != std::string::npos;
+    }
+    static bool isPop(const std::string& token, const std::string& line)
+    {
+        return (token == "ldp" || token == "LDP") && line.find("[sp]") != std::string::npos;
+    }
+    static bool isLoadMultiple(const std::string&) { return false; }
+    static bool isLinkRegister(const std::string& token) { return token == "x30" || token == "X30" || token == "lr" || token == "LR"; }
+    static bool savesLinkRegister(const std::string& token)
+    {
+        return token == "x30," || token == "X30," || token == "x30" || token == "X30" || token == "lr,";
+    }
+};
 
-        case 'r': // Print to file
-            std::filesystem::create_directory("Reports");
-            fileReader(input_file, output_file, 3);
+/***************************************************************************
+ * Every check AEC reports can be turned on or off by name in a rules file.
+ * The names are in ruleNames, in the same order as the enum. */
+enum Rule
+{
+    RULE_UNWANTED_INSTRUCTION, RULE_RESTRICTED_REGISTER, RULE_STRING_NEWLINE,
+    RULE_NO_EXIT, RULE_PUSH_POP_COUNT, RULE_UNUSED_CONDITION, RULE_ISOLATED_CODE,
+    RULE_UNUSED_LABEL, RULE_UNUSED_VARIABLE, RULE_UNUSED_CONSTANT, RULE_NO_RETURN,
+    RULE_LR_SAVE, RULE_BRANCH_OUT, RULE_STACK_BALANCE, RULE_REGISTER_BEFORE_LOAD,
+    RULE_DEAD_STORE, RULE_COUNT
+};
 
-            return 0;
+const char* const ruleNames[RULE_COUNT] = {
+    "unwanted-instruction", "restricted-register", "string-newline",
+    "no-exit", "push-pop-count", "unused-condition", "isolated-code",
+    "unused-label", "unused-variable", "unused-constant", "no-return",
+    "lr-save", "branch-out", "stack-balance", "register-before-load",
+    "dead-store"};
 
-        case 't':
-            // Makes a folder within the directory
-            std::filesystem::create_directory("Reports");
+/***************************************************************************
+ * What an operator is to the line loop, found from its spelling alone. */
+enum OperatorCheck
+{
+    CHECK_BRANCH = 1, CHECK_CALL = 2, CHECK_REGISTER_BRANCH = 4, CHECK_BARE_RETURN = 8,
+    CHECK_UNCONDITIONAL = 16, CHECK_UNWANTED = 32, CHECK_LOAD = 64, CHECK_MOVE = 128,
+    CHECK_SVC = 256, CHECK_COMPARE = 512, CHECK_LOAD_STORE = 1024, CHECK_LOAD_MULTIPLE = 2048
+};
 
-            // Iteratively looks through a folder for all the .s files and
-            // sends each one individually to fileReader
-            for (auto& file : std::filesystem::directory_iterator(input_file)) 
-            {
-                if (file.is_regular_file() && file.path().extension() == ".s") 
-                {
-                    input_file = file.path().string();
-                    output_file = "Reports/" + file.path().stem().string() + "_report.txt";
+/***************************************************************************
+ * The mnemonics of an instruction set, each with an id, and the
+ * OperatorChecks of each id. */
+struct OperatorTable
+{
+    std::unordered_map<std::string, uint16_t> ids;
+    std::vector<uint32_t> checks;
 
-                    fileReader(input_file, output_file, 3);
-                }
-            }
+    // The checks of a mnemonic, nullptr if the table doesn't have it
+    const uint32_t* find(const std::string& op) const
+    {
+        auto id = ids.find(op);
+        return id != ids.end() ? &checks[id->second] : nullptr;
+    }
+};
 
-            return 0;
+/***************************************************************************
+ * A rule set is compiled once from the rules file before any file is read
+ * and shared by every file, so the line loop only does lookups. Lists
+ * left out of the rules file keep the checks of the instruction set.
+ * compileOperators adds a table for each instruction set, the line loop
+ * looks an operator up in it once and works out the checks of spellings
+ * it doesn't have. */
+struct RuleSet
+{
+    uint32_t enabled = (1u << RULE_COUNT) - 1;
+    bool customUnwanted = false, customRestricted = false;
+    std::unordered_set<std::string> unwanted, restricted;
+    std::vector<std::string> stringExceptions = {"numInputPattern:", "strInputPattern:", "strInputError:"};
+    std::shared_ptr<const std::vector<OperatorTable>> operators;  // By IsaProfile, nullptr until compiled
+};
 
-        case 'c':
-            output_file = "AEC_Dataset.csv";
-            fileReader(input_file, output_file, 4);
+/***************************************************************************
+ * The groups of results a command can report. Line counts, Halstead's and
+ * the catastrophic errors are always found, they come from the tokens. */
+enum Output
+{
+    OUTPUT_DIAGNOSTICS = 1,     // Everything under Errors found
+    OUTPUT_USAGE = 2,           // Register, SVC, branch and directive use, call graph and addressing modes
+    OUTPUT_ALL = 3,
+    OUTPUT_IR = 4,              // Tokens for the binary IR, never part of the report
+    OUTPUT_SIMILARITY = 8,      // Token fingerprints for --similar, never part of the report
+    OUTPUT_FUNCTIONS = 16,      // Halstead's and cyclomatic of each subroutine, part of usage as well
+    OUTPUT_IR_TEXT = 32         // The analyzed text and its lines in the binary IR, --ir-text
+};
 
-            return 0;
+/***************************************************************************
+ * How the access and modify times of a file are written, --time. Text is
+ * what ctime gives, ISO is ISO-8601 local time with its UTC offset. */
+enum TimeFormat { TIME_TEXT, TIME_ISO, TIME_EPOCH };
 
-        case 'v':
-            // Iteratively looks through a folder for all the .s files and
-            // sends each one individually to fileReader
-            output_file = "AEC_Dataset.csv";
+/***************************************************************************
+ * Access and modify times of a file, read with statx. */
+struct FileTimes
+{
+    bool read = false;
+    std::time_t access = 0, modify = 0;
+};
 
-            for (auto& file : std::filesystem::directory_iterator(input_file)) 
-            {
-                if (file.is_regular_file() && file.path().extension() == ".s") 
-                {
-                    input_file = file.path().string();
-                    fileReader(input_file, output_file, 4);
-                }
-            }
+/***************************************************************************
+ * A .s file of a folder, and its times when they were read in the walk. */
+struct DirectoryFile
+{
+    std::filesystem::path path;
+    FileTimes times;
+};
 
-            return 0;
+/***************************************************************************
+ * Documents errors can be written as with --format, for -e and -t. */
+enum Format { FORMAT_TEXT, FORMAT_SARIF, FORMAT_JUNIT };
 
-        default:
-            std::cerr << "Error: AEC <filename> -h for help\n";
+/***************************************************************************
+ * A bl and the registers pushed when it is made. */
+struct CallSite
+{
+    std::string target, caller;
+    int depth = 0, line = 0;
+};
 
-            return -1;
+/***************************************************************************
+ * What the call graph knows about one subroutine. It is worked out once
+ * and reused by every caller, in a project by callers in other files too. */
+struct Subroutine
+{
+    std::string name;
+    size_t entryBlock = 0;
+    std::vector<std::string> callees;
+    std::vector<CallSite> calls;        // Every bl it makes
+    std::vector<CallSite> external;     // Calls leaving the file, made by it or anything it calls, for linking
+    int maxDepth = 0;           // Registers pushed by it and everything it calls
+    int state = 0;              // 0 not reached, 1 on the call stack being worked out, 2 done
+    bool recursive = false;
+};
+
+/***************************************************************************
+ * Halstead's and cyclomatic complexity of the code under one label while
+ * the file is read. finishAnalysis folds the labels inside a subroutine
+ * into it, so each one left is a subroutine, the program's entry or a
+ * .global label. */
+struct FunctionMetrics
+{
+    std::string name;           // Empty for code before the first label
+    int line = 0;               // Line of the label
+    int totalOperators = 0, totalOperands = 0;
+    int cyclomatic = 1;
+    std::vector<const std::string*> operators, operands;   // Every use, into the file's sets, emptied once folded
+    int uniqueOperatorCount = 0, uniqueOperandCount = 0;
+    int length = 0, vocabulary = 0;
+    double volume = 0, difficulty = 0, effort = 0;
+
+    FunctionMetrics() = default;
+    FunctionMetrics(const std::string& label, int at) : name(label), line(at) {}
+    void merge(const FunctionMetrics& other)
+    {
+        totalOperators += other.totalOperators;
+        totalOperands += other.totalOperands;
+        cyclomatic += other.cyclomatic - 1;     // Both start at 1
+        operators.insert(operators.end(), other.operators.begin(), other.operators.end());
+        operands.insert(operands.end(), other.operands.begin(), other.operands.end());
     }
+};
 
-    return 0;
-}
+/***************************************************************************
+ * Where a line of the preprocessed file came from. Lines of an included
+ * file keep their own file and line, lines made by a macro or .rept point
+ * at the line that expanded them. site is always a line of the file itself. */
+struct SourceLine
+{
+    int file = 0;   // Index into sourceFiles, 0 is the file itself
+    int line = 0;
+    int site = 0;
+};
 
 /***************************************************************************
- * filereader takes a file and command given by main to begin analysis of
- * that .s file. filereader operates by turning lines into tokens which
- * can be used to determine if errors have occured or to determine
- * statistical data about the file. filereader then reports the data
- * determined by the variable "command" */
-void fileReader(std::string input_file, std::string output_file, int command) {
-    std::unordered_set<std::string> unwantedOperators = {
-        "SWI", "LDM", "LTM", "swi", "ldm", "ltm"};
-    std::unordered_set<std::string> registers = {
-        "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "r11", "r12",
-        "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8", "R9", "R10", "R11", "R12",
-        "r13", "r14", "r15", "R13", "R14", "R15"};
-    std::unordered_set<std::string> restrictedRegisters = {
-        "r13", "r14", "r15", "R13", "R14", "R15"};
-    std::unordered_set<std::string> compareList = {
-        "EQ", "eq", "NE", "ne", "GE", "ge", "LT", "lt", "GT", "gt", "LE", "le", "CS", "cs", "CC", 
-        "cc", "MI", "mi", "PL", "pl", "VS", "vs", "VC", "vc", "HI", "hi", "LS", "ls", "AL", "al"};
+ * Lets a file already read into memory be read like a file on disk,
+ * including rewinding it, without copying it. */
+struct MemoryBuffer : std::streambuf
+{
+    explicit MemoryBuffer(const std::string* text)
+    {
+        if (text == nullptr) return;
+        char* start = const_cast<char*>(text->data());
+        setg(start, start, start + text->size());
+    }
+    MemoryBuffer(const char* text, size_t size)
+    {
+        char* start = const_cast<char*>(text);
+        setg(start, start, start + size);
+    }
+    pos_type seekoff(off_type offset, std::ios_base::seekdir way, std::ios_base::openmode) override
+    {
+        char* base = way == std::ios_base::beg ? eback() : way == std::ios_base::cur ? gptr() : egptr();
+        if (base + offset < eback() || base + offset > egptr()) return pos_type(off_type(-1));
+        setg(eback(), base + offset, egptr());
+        return pos_type(gptr() - eback());
+    }
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode) override
+    {
+        return seekoff(off_type(position), std::ios_base::beg, mode);
+    }
+};
+
+/***************************************************************************
+ * The binary IR is a flat file other tools, and AEC itself, can map into
+ * memory and read in place. A header is followed by arrays of fixed size
+ * records, each starting on an 8 byte boundary, then a table of strings
+ * and, with --ir-text, the source text. The text is what was analyzed,
+ * after macros and includes were expanded, with the source map of
+ * SourceLine records to find the lines the user wrote. Records name
+ * strings by offset and length into the string table, lines by offset and
+ * length into the text. Lines and instructions are numbered from 1 and 0.
+ * The instruction, label, directive and finding records are of the lines
+ * before finishAnalysis; what else the lines showed, like the line counts
+ * and Halstead's, follows as an AnalysisArchive, so AEC analyzes an IR
+ * file without tokenizing it again. IR_VERSION changes whenever a record
+ * changes. */
+const char IR_MAGIC[8] = {'A', 'E', 'C', 'I', 'R', '\r', '\n', 0};
+const uint32_t IR_VERSION = 7;
+const uint32_t IR_BYTE_ORDER = 0x01020304;     // Read back differently on a machine of the other byte order
+
+struct IrString
+{
+    uint32_t offset, length;
+};
+
+struct IrHeader
+{
+    char magic[8];
+    uint32_t version, byteOrder;
+    uint32_t isa;
+    uint32_t lineCount, instructionCount, operandCount, labelCount, directiveCount;   // No lines without --ir-text
+    uint32_t sourceFileCount, sourceMapCount;   // Where expanded lines came from, 0 if nothing was expanded
+    uint32_t findingCount, reserved;
+    uint64_t linesOffset, instructionsOffset, operandsOffset, labelsOffset, directivesOffset;
+    uint64_t findingsOffset;
+    uint64_t sourceFilesOffset, sourceMapOffset;
+    uint64_t stringsOffset, stringsSize, textOffset, textSize;
+    uint64_t analysisOffset, analysisSize;
+};
+
+struct IrInstruction
+{
+    uint32_t line;
+    IrString op;
+    uint32_t firstOperand, operandCount;    // Into the operand array
+    uint32_t useMask, argumentMask, defMask, clobberMask;
+    int32_t stackDelta;
+    uint8_t flow, conditional, restore, call;
+    uint8_t mode;                   // AddressMode of a load or store
+    IrString target;
+};
+
+struct IrLabel
+{
+    IrString name;
+    uint32_t line, instruction;     // First instruction after the label
+};
+
+struct IrDirective
+{
+    IrString name;
+    uint32_t line;
+};
+
+// A finding is written in the order of its list, a message no format makes is kept whole
+struct IrFinding
+{
+    uint32_t kind;          // Finding, or FINDING_COUNT + its list in findingLists with the message as operand
+    uint32_t line;
+    IrString operand;       // Empty if the message names none
+};
+
+/***************************************************************************
+ * A binary IR file mapped into memory. The sections point straight into
+ * the mapping, nothing is copied. */
+struct IrFile
+{
+    const char* data = nullptr;
+    size_t size = 0;
+    const IrHeader* header = nullptr;
+
+    // nullptr if a record at offset wouldn't be aligned, the writer puts every section on an 8 byte boundary
+    template <class T> const T* section(uint64_t offset) const
+    {
+        if (offset % alignof(T) != 0 || offset > size) return nullptr;
+        return reinterpret_cast<const T*>(data + offset);
+    }
+    std::string text(IrString s) const
+    {
+        if (s.offset > header->stringsSize || s.length > header->stringsSize - s.offset) return "";
+        return std::string(data + header->stringsOffset + s.offset, s.length);
+    }
+    ~IrFile() { if (data != nullptr) munmap(const_cast<char*>(data), size); }
+};
+
+/***************************************************************************
+ * The state a piece of a file starts in when a very large file is split
+ * at its labels and the pieces are analyzed at the same time. */
+struct ChunkStart
+{
+    int line = 0;               // Lines before the chunk
+    bool dataFlag = false;      // Starts inside .data
+    bool globalFlag = false;    // .global was seen before it
+};
+
+/***************************************************************************
+ * Everything learned about one file. analyzeFile fills in what the lines
+ * themselves show, finishAnalysis adds the checks that need the whole
+ * file, and writeResults reports it for the command that was given. */
+struct FileAnalysis
+{
+    std::string inputFile;
+    IsaProfile isa = ISA_ARM32;
+    RegisterModel model;
     std::unordered_set<std::string> uniqueOperands, uniqueOperators, subroutines;
-    std::unordered_set<int> register0Use, register1Use, register2Use, register3Use;
-    std::unordered_set<int> register4Use, register5Use, register6Use, register7Use;
-    std::unordered_set<int> register8Use, register9Use, register10Use, register11Use, register12Use;
-    std::unordered_set<int> register13Use, register14Use, register15Use;
-    std::vector<std::string> labels, variables, constants;
+    std::vector<std::unordered_set<int>> registerUse = std::vector<std::unordered_set<int>>(32);
+    std::vector<std::string> labels, variables, constants, globals;
+    std::vector<std::string> streamedLabels;    // Labels of windows already checked in streaming mode
+    std::vector<int> streamedLabelLineNum;      // Correlated positionally with streamedLabels
+    std::string sourceText;     // The analyzed text, only kept for the binary IR with --ir-text
+    std::vector<uint64_t> tokenHashes, fingerprints;    // Normalized tokens and their winnowed k-grams, only for --similar
     std::vector<std::string> stringError, unwantedInstructions, branchUse;
     std::vector<std::string> svcUse, subroutineUse, isolatedCode;
     std::vector<std::string> unusedConditional, unusedLabel, unusedVariable, unusedConstant;
     std::vector<std::string> restrictedError, noReturnError, lrSaveError;
     std::vector<std::string> branchOutError, registerError;
-    std::vector<std::string> indirectMode, indirectOffsetMode, preIndexMode;
-    std::vector<std::string> postIndexMode, pcRelativeMode, pcLiteralMode, unsureMode;
-    std::string line, token, subtoken, linePreComment;
-    std::ifstream infile(input_file);
-    std::vector<int> labelLineNum, returnLineNum, blCallLineNum; 
-    std::vector<int> lrSaveLineNum, badBranchLineNum, sorter;
-    std::unordered_map<std::string, std::vector<int>> directiveUse;
+    std::vector<std::string> deadStoreError, stackError, callGraphUse;
+    std::vector<int> addressLines[MODE_COUNT];  // Lines of each addressing mode, none for MODE_NONE
+    std::vector<int> labelLineNum, returnLineNum, blCallLineNum;
+    std::vector<int> lrSaveLineNum, badBranchLineNum;
+    std::vector<int> variableLineNum, constantLineNum;     // Correlated positionally with variables and constants
+    std::vector<std::string> badBranchTarget;   // Correlated positionally with badBranchLineNum
+    std::map<std::string, std::vector<int>> directiveUse;  // Sorted so reports list directives the same every run
+    std::vector<FunctionMetrics> functions;     // One per label while reading, one per subroutine once finished
+    std::vector<Instruction> code;      // Register events for the dataflow engine
+    std::unordered_map<std::string, size_t> labelIndex;    // Label to its first instruction
+    std::vector<std::string> sourceFiles;   // The file and everything it includes
+    std::vector<SourceLine> sourceMap;      // Preprocessed line - 1 to where it came from, empty if nothing expanded
+    std::unordered_set<std::string> preprocessorUses;  // Symbols .if, .rept and .equ read, uses no operand shows
     int fullCommentLines = 0, blankLines = 0, totalLines = 0;
     int linesWComment = 0, linesWOComment = 0, dirLines = 0;
     int totalOperators = 0, totalOperands = 0;
-    int cyclomatic = 1, commentPos, cmpLine, dataLineNum, nextLabel;
-    int pushNum = 0, popNum = 0, numTokens = 0;
-    bool operatorFlag = false, branchFlag = false, movFlag = false;
-    bool globalFlag = false, dataFlag = false, globalErrorFlag = false;
-    bool checkSVC = false, exitExists = false, dataExists = false;
-    bool restrictedRegisterFlag = false, pushFlag = false, equFlag = false;
-    bool blBranchFlag = false, noReturnBranch = false, cmpNextLine = false;
-    bool subroutineFlag = false, returnFlag = false, bxBranchFlag = false;
-    bool subroutineCall = false, lrSaved = false, popFlag = false;
-    bool ldrFlag = false, strFlag = false, movPCFlag = false;
-    bool r0Flag = false, r1Flag = false, r2Flag = false, r3Flag = false, r4Flag = false;
-    bool r5Flag = false, r6Flag = false, r7Flag = false, r8Flag = false;
-    bool r9Flag = false, r10Flag = false, r11Flag = false, r12Flag = false;
-    bool r0ErrorFlag = false, r1ErrorFlag = false, r2ErrorFlag = false;
-    bool r3ErrorFlag = false, r4ErrorFlag = false, r5ErrorFlag = false; 
-    bool r6ErrorFlag = false, r7ErrorFlag = false, r8ErrorFlag = false;
-    bool r9ErrorFlag = false, r10ErrorFlag = false, r11ErrorFlag = false, r12ErrorFlag = false;
+    int cyclomatic = 1, dataLineNum = 0;
+    int pushNum = 0, popNum = 0;
+    bool exitExists = false, dataExists = false, globalErrorFlag = false;
+    uint32_t enabledRules = (1u << RULE_COUNT) - 1;
+    uint32_t outputs = OUTPUT_ALL;
+    size_t streamBudget = 0;        // Instructions kept in streaming mode before a window is checked, 0 if off
+    std::ostream* streamOut = &std::cout;   // Where streaming mode prints the errors of each window
+    FileTimes times;                // Read in the directory walk by the corpus reader, otherwise when reported
+    int timeFormat = TIME_TEXT;
+    int length = 0, vocabulary = 0;     // Halstead's
+    double volume = 0, difficulty = 0, effort = 0;
+    std::string failure;        // Why a worker process couldn't analyze the file, empty if it could
+};
+
+/***************************************************************************
+ * The list each rule reports its errors in, nullptr for the no exit and
+ * push/pop checks which are flags. */
+std::vector<std::string> FileAnalysis::* const ruleOutput[RULE_COUNT] = {
+    &FileAnalysis::unwantedInstructions, &FileAnalysis::restrictedError, &FileAnalysis::stringError,
+    nullptr, nullptr, &FileAnalysis::unusedConditional, &FileAnalysis::isolatedCode,
+    &FileAnalysis::unusedLabel, &FileAnalysis::unusedVariable, &FileAnalysis::unusedConstant,
+    &FileAnalysis::noReturnError, &FileAnalysis::lrSaveError, &FileAnalysis::branchOutError,
+    &FileAnalysis::stackError, &FileAnalysis::registerError, &FileAnalysis::deadStoreError};
+
+/***************************************************************************
+ * The errors and uses found on single lines. Each is a message of a line
+ * that may name one operand, so the binary IR keeps them as records of
+ * which finding, the line and the operand. findingText writes the message,
+ * the line loop and loadIr both make them with it. */
+enum Finding
+{
+    FINDING_UNUSED_CONDITION, FINDING_ISOLATED_CODE, FINDING_UNWANTED, FINDING_RESTRICTED,
+    FINDING_STRING_NEWLINE, FINDING_RETURN, FINDING_CALL, FINDING_RETURN_BRANCH,
+    FINDING_BRANCH, FINDING_SVC, FINDING_COUNT
+};
+
+struct FindingFormat
+{
+    std::vector<std::string> FileAnalysis::* list;
+    const char* before;     // The message is before, the operand, after and the line
+    const char* after;
+};
+
+const FindingFormat findingFormats[FINDING_COUNT] = {
+    {&FileAnalysis::unusedConditional, "Condition flag updated but unused", ""},
+    {&FileAnalysis::isolatedCode, "Code after unconditional branch", ""},
+    {&FileAnalysis::unwantedInstructions, "Unexpected instruction", ""},
+    {&FileAnalysis::restrictedError, "Improper use of restricted register ", ""},
+    {&FileAnalysis::stringError, "String did not end with \\n", ""},
+    {&FileAnalysis::subroutineUse, "Return ", ""},
+    {&FileAnalysis::subroutineUse, "BL ", ""},
+    {&FileAnalysis::subroutineUse, "Return branch ", ""},
+    {&FileAnalysis::branchUse, "Branch ", ""},
+    {&FileAnalysis::svcUse, "SVC ", " used"}};
 
-    if (!infile.is_open())  // Check if file successfully opened
+// The lists that only hold findings, in the order the binary IR writes them
+std::vector<std::string> FileAnalysis::* const findingLists[] = {
+    &FileAnalysis::unusedConditional, &FileAnalysis::isolatedCode, &FileAnalysis::unwantedInstructions,
+    &FileAnalysis::restrictedError, &FileAnalysis::stringError, &FileAnalysis::subroutineUse,
+    &FileAnalysis::branchUse, &FileAnalysis::svcUse};
+const uint32_t findingListCount = sizeof(findingLists) / sizeof(findingLists[0]);
+
+std::string findingText(Finding kind, const std::string& operand, int line)
+{
+    return findingFormats[kind].before + operand + findingFormats[kind].after + " at line " + std::to_string(line);
+}
+
+/***************************************************************************
+ * A quantile sketch with fixed relative error. Values are counted in
+ * buckets whose bounds grow by gamma, so any quantile is found within 1%
+ * of its real value. Sketches merge by adding their buckets, so each
+ * thread can keep its own and the order files are added in never matters. */
+struct QuantileSketch
+{
+    static constexpr double gamma = 1.02;   // (1 + 1%) / (1 - 1%)
+    std::map<int, uint64_t> buckets;        // Bucket of values in (gamma^(i-1), gamma^i]
+    uint64_t zeros = 0, count = 0;          // Zero and negative values share a bucket
+    double sum = 0, min = 0, max = 0;
+
+    void add(double value)
     {
-        std::cerr << "Error: Failed to open file: " << input_file;
-        exit(-1);
+        if (std::isnan(value) || std::isinf(value)) return;
+        if (count == 0 || value < min) min = value;
+        if (count == 0 || value > max) max = value;
+        count++;
+        sum += value;
+        if (value <= 0) zeros++;
+        else buckets[int(std::ceil(std::log(value) / std::log(gamma)))]++;
     }
-
-    /***************************************************************************
-     * This sections reads and stores the file in a vector of strings
-     * It also collects all the labels and custom variables for later analysis*/
-    while (std::getline(infile, line)) 
+    void merge(const QuantileSketch& other)
     {
-        // Push the new line into a vector of strings to be able to test it later
-        // Also establish each new lines flags
-        totalLines++;
-        operatorFlag = false;
-        restrictedRegisterFlag = false;
-        branchFlag = false;
-        blBranchFlag = false;
-        bxBranchFlag = false;
-        pushFlag = false;
-        movFlag = false;
-        ldrFlag = false;
-        strFlag = false;
-        equFlag = false;
-        movPCFlag = false;
-        popFlag = false;
-        numTokens = 0;
-        r0ErrorFlag = false;
-        r1ErrorFlag = false;
-        r2ErrorFlag = false;
-        r3ErrorFlag = false;
-        r4ErrorFlag = false;
-        r5ErrorFlag = false;
-        r6ErrorFlag = false;
-        r7ErrorFlag = false;
-        r8ErrorFlag = false;
-        r9ErrorFlag = false;
-        r10ErrorFlag = false;
-        r11ErrorFlag = false;
-        r12ErrorFlag = false;
-        std::istringstream iss(line);    // Grab token of line to check first token
-        iss >> token;  
-
-        /**************************************************************************
-         * A line can be empty, a full comment, or have functional code in it
-         * From there it can have a comment or not */
-        if (line.find_first_not_of(' ') == std::string::npos) 
-        {
-            blankLines++;
-        } 
-        else if (token[0] == '@' || token[0] == '/')
+        if (other.count == 0) return;
+        if (count == 0 || other.min < min) min = other.min;
+        if (count == 0 || other.max > max) max = other.max;
+        count += other.count;
+        sum += other.sum;
+        zeros += other.zeros;
+        for (auto& bucket : other.buckets) buckets[bucket.first] += bucket.second;
+    }
+    double quantile(double q) const
+    {
+        uint64_t rank = uint64_t(q * (count - 1)), seen = zeros;
+        if (count == 0) return 0;
+        if (rank < seen) return std::min(0.0, max);
+        for (auto& bucket : buckets)
         {
-            fullCommentLines++;
+            seen += bucket.second;
+            if (rank < seen) return std::min(max, std::max(min, 2 * std::pow(gamma, bucket.first) / (gamma + 1)));
         }
-        else
+        return max;
+    }
+};
+
+/***************************************************************************
+ * Totals over a whole corpus, kept while the files are analyzed so no
+ * per-file data has to be written out and read back. */
+struct CorpusStatistics
+{
+    uint64_t files = 0, rejected = 0;
+    QuantileSketch volume, effort, difficulty, cyclomatic, lines;
+    uint64_t errors[RULE_COUNT] = {};       // Errors found by each rule
+    uint64_t filesWithError[RULE_COUNT] = {};
+    std::unordered_map<std::string, uint64_t> operators;   // Files using each operator
+
+    void add(const FileAnalysis&);
+    void merge(const CorpusStatistics&);
+};
+
+/***************************************************************************
+ * An inverted index from fingerprints to the files that have them. Pairs
+ * of files are only compared through the fingerprints they share, never
+ * every file against every other one. */
+struct SimilarityIndex
+{
+    std::unordered_map<uint64_t, std::vector<uint32_t>> files;  // Files with each fingerprint, by corpus order
+
+    void add(uint32_t file, const std::vector<uint64_t>& fingerprints)
+    {
+        for (uint64_t print : fingerprints) files[print].push_back(file);
+    }
+    void merge(SimilarityIndex& other)
+    {
+        for (auto& print : other.files)
         {
-            if (line.find("@") != std::string::npos || line.find("/") != std::string::npos) 
-            {
-                linesWComment++;
-            } 
-            else 
-            {
-                linesWOComment++;
-            }
+            auto& list = files[print.first];
+            list.insert(list.end(), print.second.begin(), print.second.end());
+        }
+        other.files.clear();
+    }
+};
 
-            /*********************************************************************************
-             * Comments don't need to be tokenized so we make sublines without them.
-             * The example programs have comments with @ and / * so we check for both. */
-            if(line.find('@') != std::string::npos) commentPos = line.find('@'); // End at @
-            else if(line.find('/') != std::string::npos) commentPos = line.find('/'); // End at /
-            else commentPos = line.size();  // If no comment is detected grab full line
-            linePreComment = line.substr(0, commentPos);    // Get rid of comment
+/***************************************************************************
+ * The symbol tables of every file in a project merged together, so a file
+ * can see how the others use its labels. */
+struct ProjectSymbols
+{
+    std::unordered_map<std::string, size_t> globalFile;   // .global label to the file defining it
+    std::unordered_set<std::string> referenced;     // Operands used by any file
+    std::unordered_set<std::string> called;         // bl targets of any file
+    std::unordered_map<std::string, Subroutine> summaries;  // Call graph of each global subroutine, linked over every file
+};
 
-            std::istringstream issToken(linePreComment);    // Grab tokens of the uncommented line
+/***************************************************************************
+ * Files pulled in with .include are read once per run and shared by every
+ * file that includes them. Files of a project are read on several threads
+ * at once, so the table is locked while it is used. */
+struct IncludeCache
+{
+    std::mutex lock;
+    std::unordered_map<std::string, std::shared_ptr<const std::vector<std::string>>> files;
+};
 
-            while (issToken >> token)   // While there are still tokens on the line
-            {
-                if (!token.empty()) 
-                {
-                    numTokens++; // Placement checker for tokens
+/***************************************************************************
+ * A .macro definition, kept until the end of the file being preprocessed. */
+struct Macro
+{
+    std::vector<std::string> parameters, defaults;
+    std::vector<std::string> body;
+};
 
-                    /***************************************************************************************
-                     * A token can be identified by its position and by its contents. A token in the first
-                     * position that lacks any other defining elements, like : or . is an operator. This
-                     * kind of logic prevents the need for sets which may not hold all available operators.*/
-                    if (numTokens == 1 && token[0] != '.' && token.back() != ':')
-                    {
-                        totalOperators++;               // Halstead's total operators
-                        uniqueOperators.insert(token);  // Halstead's unique operators
-                        operatorFlag = true;    // Establish that the rest of the tokens in this line are operands
+// Nested .rept and macros stop expanding past this many lines
+const size_t maxExpandedLines = 1 << 22;
 
-                        /*****************************************************************************************
-                         * cmpNextLine means the previous lines operator was cmp. We then check individually that
-                         * the token, the next operator contains a conditional flag to validate the need for the
-                         *  cmp operator. */
-                        if(cmpNextLine == true)
-                        {
-                            if(token.length() > 2)  // Don't want to grab subtoken of 2 if token isn't large enough
-                            {
-                                subtoken = token.substr(token.length() - 2, 2);   // Grab only the last 2 characters of the token
-                                if(compareList.find(subtoken) == compareList.end()) // Check against list of comparison commands
-                                {
-                                    unusedConditional.push_back("Condition flag updated but unused at line " + std::to_string(cmpLine - 1));
-                                }
+// Files at least this large are split up and analyzed on every core
+const std::uintmax_t parallelFileSize = 4 << 20;
 
-                            }
-                            else    // If token isn't large enough, it doesn't have a conditional element
-                            {
-                                unusedConditional.push_back("Condition flag updated but unused at line " + std::to_string(cmpLine));
-                            }
+/***************************************************************************
+ * A parsed JSON value, enough for the messages of the language server.
+ * Objects keep their members in order as pairs. */
+struct JsonValue
+{
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT } type = JSON_NULL;
+    bool boolean = false;
+    double number = 0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
 
-                            cmpNextLine = false;
-                        }
-                        /*****************************************************************
-                         * noReturnBranch stores an error if there was an operator used
-                         * after a b branch but before a new label*/
-                        if(noReturnBranch == true)
-                        {
-                            isolatedCode.push_back("Code after unconditional branch at line " + std::to_string(totalLines));
-                        }
-                        /*****************************************************************
-                         * if the first character of an operator is a b then the operator
+    const JsonValue& operator[](const std::string& key) const
+    {
+        static const JsonValue none;
+        for (auto& member : members) if (member.first == key) return member.second;
+        return none;
+    }
+};
+
+/***************************************************************************
+ * What analyzeIncremental keeps of a file between analyses: the analysis
+ * of each region between labels, by the hash of its text and the section
+ * it starts in. */
+struct IncrementalRegion
+{
+    FileAnalysis part;
+    int line = 0;               // Where the lines of part are counted from
+    uint64_t generation = 0;    // Last analysis the region was part of, 0 if new
+};
+
+struct IncrementalAnalysis
+{
+    IsaProfile isa = ISA_DETECT;
+    uint32_t outputs = 0, enabledRules = 0;
+    std::unordered_map<uint64_t, IncrementalRegion> regions;
+    uint64_t generation = 0;
+    size_t reread = 0;      // Regions read again by the last analysis
+};
+
+typedef std::function<void(std::istream&, FileAnalysis&, const ChunkStart&)> LineAnalyzer;
+
+/***************************************************************************
+ * An open document of the language server, kept as lines so an edit only
+ * touches the lines it changes. */
+struct LspDocument
+{
+    std::string path;
+    std::vector<std::string> lines = std::vector<std::string>(1);
+    IncrementalAnalysis cache;
+    bool dirty = false;     // Changed since its diagnostics were published
+};
+
+/***************************************************************************
+ * Options from the command line that every analyzed file shares. outputs
+ * is what the command will report, the passes nothing reports are skipped. */
+struct AnalysisOptions
+{
+    IsaProfile isa = ISA_DETECT;
+    RuleSet rules;
+    IncludeCache* includes = nullptr;
+    uint32_t outputs = OUTPUT_ALL;
+    size_t streamBudget = 0;        // Streaming mode window size in instructions, 0 if off
+    bool statistics = false;        // Write corpus statistics for -t and -v
+    int similarity = 0;             // Percent of shared fingerprints --similar reports a pair at, 0 if off
+    int format = FORMAT_TEXT;       // Document the errors are written as
+    int timeFormat = TIME_TEXT;     // How file times are written in reports and datasets
+    bool isolate = true;            // -t and -v analyze in worker processes, so a crash only loses its file
+    int timeLimit = 60;             // Seconds a worker gets for one file, 0 if unlimited
+    size_t memoryLimit = 4096;      // Megabytes a worker can allocate for one file, 0 if unlimited
+    std::ostream* log = &std::cerr;     // Where files that can't be expanded are reported, the C interface keeps it
+    bool irText = false;            // -i writes the analyzed text and its lines too, for tools that show them
+};
+
+/***************************************************************************
+ * Writes the errors of many files as one SARIF or JUnit XML document, a
+ * file at a time as they are analyzed, so nothing but the file being
+ * written is held in memory. */
+struct DiagnosticWriter
+{
+    std::ostream& out;
+    int format;
+    size_t results = 0;     // SARIF results written so far
+
+    DiagnosticWriter(std::ostream& stream, int kind) : out(stream), format(kind) {}
+    void begin();
+    void file(const FileAnalysis&);
+    void end();
+};
+
+/***************************************************************************
+ * A FileAnalysis as bytes, so a worker process can send back what it
+ * found. field writes a value to bytes, or reads it back when reading is
+ * set, so one list of fields serves both ways. Reading stops with failed
+ * set if the bytes end too soon. */
+struct AnalysisArchive
+{
+    std::string bytes;
+    size_t pos = 0;
+    bool reading = false, failed = false;
+    bool skipRecords = false;   // Leave out what the binary IR has records of
+    FileAnalysis* owner = nullptr;      // The file whose sets the uses of its functions point into
+    // A set's names sorted, and where each is, which both ends agree on however the set is stored
+    struct SortedNames
+    {
+        std::vector<const std::string*> names;
+        std::unordered_map<const std::string*, uint32_t> index;
+    };
+    std::unordered_map<const std::unordered_set<std::string>*, SortedNames> sorted;
+
+    void raw(void* data, size_t size)
+    {
+        if (size == 0) return;
+        if (!reading) bytes.append(static_cast<const char*>(data), size);
+        else if (failed || size > bytes.size() - pos) failed = true;
+        else
+        {
+            std::memcpy(data, bytes.data() + pos, size);
+            pos += size;
+        }
+    }
+    // Size of a list, never more than the bytes left when read back
+    size_t count(size_t size)
+    {
+        uint64_t value = size;
+        raw(&value, sizeof(value));
+        if (reading && (failed || value > bytes.size() - pos)) failed = true;
+        return failed ? 0 : value;
+    }
+
+    // Bools and enums can't take any byte read, so they have their own fields below and never come through here
+    template <class T> using Plain = std::integral_constant<bool, std::is_trivially_copyable<T>::value &&
+        !std::is_enum<T>::value && !std::is_same<T, bool>::value>;
+    template <class T> typename std::enable_if<Plain<T>::value>::type field(T& value) { raw(&value, sizeof(T)); }
+    void field(bool& flag)
+    {
+        uint8_t value = flag;
+        raw(&value, sizeof(value));
+        if (reading && value > 1) failed = true;
+        flag = value == 1;
+    }
+    // An enum, or an int holding one, kept as 4 bytes and below count when read back
+    template <class T> void choice(T& value, uint32_t count)
+    {
+        uint32_t number = uint32_t(value);
+        raw(&number, sizeof(number));
+        if (reading && !failed && number >= count) failed = true;
+        if (reading && !failed) value = T(number);
+    }
+    void field(FileTimes& times)
+    {
+        field(times.read);
+        field(times.access);
+        field(times.modify);
+    }
+    void field(std::string& text)
+    {
+        text.resize(count(text.size()));
+        raw(&text[0], text.size());
+    }
+    template <class T> void field(std::vector<T>& list)
+    {
+        list.resize(count(list.size()));
+        if constexpr (Plain<T>::value) raw(list.data(), list.size() * sizeof(T));
+        else for (auto& item : list) field(item);
+    }
+    // Writing never changes an item, so the keys of sets and maps can be passed on
+    template <class T> void field(std::unordered_set<T>& set)
+    {
+        size_t size = count(set.size());
+        if (!reading) for (auto& item : set) field(const_cast<T&>(item));
+        for (size_t i = 0; reading && i < size && !failed; i++)
+        {
+            T item;
+            field(item);
+            set.insert(std::move(item));
+        }
+    }
+    template <class K, class V> void field(std::map<K, V>& map)
+    {
+        size_t size = count(map.size());
+        if (!reading) for (auto& entry : map) { field(const_cast<K&>(entry.first)); field(entry.second); }
+        for (size_t i = 0; reading && i < size && !failed; i++)
+        {
+            K key;
+            field(key);
+            field(map[key]);
+        }
+    }
+    void field(FunctionMetrics&);
+    void field(FileAnalysis&);
+    void uses(std::vector<const std::string*>&, const std::unordered_set<std::string>&);
+};
+
+/***************************************************************************
+ * Worker processes that analyze the files of -t and -v, so a file that
+ * crashes AEC, runs too long or uses too much memory only loses itself.
+ * The workers are kept: each is sent a file at a time and sends back the
+ * analysis. A worker that dies is reaped, the file it was on is recorded
+ * as failed and a new worker is started for the next file.
+ * Workers are never forked from AEC once its threads run, as a thread
+ * could hold a lock the worker needs. A spawner process is forked when
+ * the pool is made, while AEC has one thread, and forks every worker. It
+ * sends back the worker's ends of the pipes over a socket and reaps the
+ * workers it is asked to. */
+struct WorkerPool
+{
+    struct Worker
+    {
+        pid_t pid = -1;
+        int requests = -1, replies = -1;    // Files to the worker, analyses back
+    };
+    std::vector<Worker> workers;
+    std::mutex lock;        // Held while the spawner is used
+    pid_t spawner = -1;
+    int control = -1;       // Socket to the spawner
+    int command;
+    const AnalysisOptions& options;
+
+    WorkerPool(size_t, int, const AnalysisOptions&);
+    ~WorkerPool();
+    bool start(size_t);
+    int stop(size_t);
+    int reap(pid_t);
+    void analyze(size_t, const std::string&, const std::string*, FileAnalysis&);
+};
+
+void fileReader(std::string, std::string, int, const AnalysisOptions&);
+bool analyzeFile(const std::string&, FileAnalysis&, const AnalysisOptions&, const std::string* = nullptr);
+template <class Isa> void analyzeLines(std::istream&, FileAnalysis&, const RuleSet&, const ChunkStart& = ChunkStart());
+template <class Isa> AddressMode decodeAddress(const std::string&);
+bool isLoadStore(const std::string&);
+template <class Isa> uint32_t operatorChecks(const std::string&, const RuleSet&);
+void compileOperators(RuleSet&);
+void analyzeChunks(const std::string&, FileAnalysis&, const LineAnalyzer&);
+LineAnalyzer analyzerFor(IsaProfile, const RuleSet&);
+void splitAtLabels(const std::string&, size_t, std::vector<size_t>&, std::vector<ChunkStart>&);
+void analyzeIncremental(const std::string&, const std::string&, IncrementalAnalysis&, FileAnalysis&, const AnalysisOptions&);
+void shiftLines(FileAnalysis&, int);
+void mergeAnalysis(FileAnalysis&, const FileAnalysis&);
+void foldFunctions(FileAnalysis&);
+void writeFunctions(const FileAnalysis&, std::ostream&);
+IsaProfile detectIsa(std::istream&);
+bool preprocessFile(std::istream&, FileAnalysis&, IncludeCache*, std::string&, std::ostream& = std::cerr);
+bool precheckFile(const std::string&, FileAnalysis&, const std::string* = nullptr);
+void corpusReader(std::string, int, const AnalysisOptions&);
+bool analyzeCorpusFile(const std::string&, int, const AnalysisOptions&, const std::string*, FileAnalysis&);
+void runWorker(int, int, int, const AnalysisOptions&);
+void runSpawner(int, int, const AnalysisOptions&);
+bool readAll(int, void*, size_t);
+bool writeAll(int, const void*, size_t);
+void writeStatistics(const CorpusStatistics&, const std::string&);
+void writeSimilarity(SimilarityIndex&, const std::vector<std::string>&, const std::vector<uint32_t>&, int, const std::string&);
+uint64_t hashToken(const std::string&, bool);
+void winnowTokens(FileAnalysis&);
+int precheckReader(std::string, const AnalysisOptions&);
+void mapSourceLines(FileAnalysis&);
+void finishAnalysis(FileAnalysis&, const ProjectSymbols*);
+void checkWindow(FileAnalysis&, const ProjectSymbols*, int);
+void dropDisabledRules(FileAnalysis&);
+void forEachError(const FileAnalysis&, const std::function<void(int, const std::string&)>&);
+int errorLine(const std::string&);
+std::string xmlEscape(const std::string&);
+std::string uriEscape(const std::string&);
+void streamWindow(FileAnalysis&, int);
+void writeResults(const FileAnalysis&, const std::string&, int);
+void writeErrors(const FileAnalysis&, std::ostream&, bool);
+bool writeIr(const FileAnalysis&, const std::string&);
+bool openIr(const std::string&, IrFile&);
+bool loadIr(const IrFile&, FileAnalysis&);
+void writeMetadata(const FileAnalysis&, std::ostream&);
+FileTimes fileTimes(const FileAnalysis&);
+bool readTimes(int, const char*, FileTimes&);
+std::string formatTime(std::time_t, int);
+long localOffset(std::time_t);
+void projectReader(std::string, const AnalysisOptions&);
+int lspServer(AnalysisOptions);
+bool parseJson(const std::string&, size_t&, JsonValue&);
+std::string jsonEscape(const std::string&);
+std::string jsonId(const JsonValue&);
+bool readLspMessage(std::string&);
+void writeLspMessage(const std::string&);
+void applyLspChange(LspDocument&, const JsonValue&);
+void publishDiagnostics(const std::string&, LspDocument&, const AnalysisOptions&);
+std::unordered_map<std::string, int> definitionLines(const FileAnalysis&);
+int definitionLine(const std::string&, const std::unordered_map<std::string, int>&);
+bool loadRules(const std::string&, RuleSet&, std::ostream& = std::cerr);
+void parallelFor(size_t, const std::function<void(size_t)>&);
+std::vector<DirectoryFile> assemblyFiles(const std::string&, bool = false);
+bool hasConditionSuffix(const std::string&);
+std::vector<BasicBlock> buildBlocks(const std::vector<Instruction>&, const std::unordered_map<std::string, size_t>&,
+    const std::unordered_set<std::string>&, const RegisterModel&, std::vector<size_t>&);
+void registerDataflow(const std::vector<Instruction>&, std::vector<BasicBlock>&, const RegisterModel&,
+    std::vector<std::string>&, std::vector<std::string>&);
+void callGraph(const std::vector<Instruction>&, const std::vector<BasicBlock>&, const std::vector<size_t>&,
+    const std::unordered_map<std::string, size_t>&, const std::vector<std::string>&,
+    const std::unordered_set<std::string>&, const ProjectSymbols*, std::unordered_map<std::string, Subroutine>*,
+    std::vector<std::string>&, std::vector<std::string>&);
+void linkCallGraph(std::vector<FileAnalysis>&, ProjectSymbols&);
+
+#ifndef AEC_LIBRARY     // Built as libaec, see AEC.h
+/*************************************************************************
+ * main takes the command line given by the user and calls filereader
+ * based on the commands given in the command line. */
+int main(int argc, char* argv[]) {
+    // Before ANYTHING is done, we check that we have correct input
+    // Format for command is AEC <filename> <command> or AEC <directory> -t
+    // followed by any options
+    bool lsp = argc >= 2 && std::string(argv[1]) == "--lsp";
+    if (argc < 3 && !lsp) 
+    {
+        std::cerr << "Correct formats: AEC <filename> <command> [options] || AEC <directory> -t [options]\n";
+        return -1;
+    }
+
+    std::string input_file = lsp ? "" : argv[1];
+    std::string output_file = "Reports/" + input_file.substr(0, input_file.find_last_of(".")) + "_report.txt";
+    std::string command = lsp ? argv[1] : argv[2];
+    AnalysisOptions options;
+    IncludeCache includes;
+    options.includes = &includes;
+    bool workerOption = false;      // --timeout or --memory was given
+
+    // Options: --isa=arm32|thumb|aarch64 picks the instruction set instead of
+    // detecting it from the directives of each file, --rules=<file> loads
+    // a rules file that turns checks on or off
+    for (int i = lsp ? 2 : 3; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option == "--isa=arm32") options.isa = ISA_ARM32;
+        else if (option == "--isa=thumb") options.isa = ISA_THUMB;
+        else if (option == "--isa=aarch64") options.isa = ISA_AARCH64;
+        else if (option == "--stats") options.statistics = true;
+        else if (option == "--similar") options.similarity = 50;
+        else if (option.rfind("--similar=", 0) == 0 && std::atoi(option.c_str() + 10) > 0 && std::atoi(option.c_str() + 10) <= 100)
+        {
+            options.similarity = std::atoi(option.c_str() + 10);
+        }
+        else if (option == "--format=text") options.format = FORMAT_TEXT;
+        else if (option == "--format=sarif") options.format = FORMAT_SARIF;
+        else if (option == "--format=junit") options.format = FORMAT_JUNIT;
+        else if (option == "--time=text") options.timeFormat = TIME_TEXT;
+        else if (option == "--time=iso") options.timeFormat = TIME_ISO;
+        else if (option == "--time=epoch") options.timeFormat = TIME_EPOCH;
+        else if (option == "--stream") options.streamBudget = 4096;
+        else if (option.rfind("--stream=", 0) == 0 && std::atoi(option.c_str() + 9) > 0)
+        {
+            options.streamBudget = std::atoi(option.c_str() + 9);
+        }
+        else if (option == "--in-process") options.isolate = false;
+        else if (option == "--ir-text") options.irText = true;
+        else if (option.rfind("--timeout=", 0) == 0 && std::atoi(option.c_str() + 10) >= 0)
+        {
+            options.timeLimit = std::atoi(option.c_str() + 10);
+            workerOption = true;
+        }
+        else if (option.rfind("--memory=", 0) == 0 && std::atoi(option.c_str() + 9) >= 0)
+        {
+            options.memoryLimit = std::atoi(option.c_str() + 9);
+            workerOption = true;
+        }
+        else if (option.rfind("--rules=", 0) == 0)
+        {
+            if (!loadRules(option.substr(8), options.rules)) return -1;
+        }
+        else
+        {
+            std::cerr << "Error: Unknown option " << option << ", AEC <filename> -h for help\n";
+            return -1;
+        }
+    }
+    compileOperators(options.rules);    // Once the rules file is read
+
+    if (options.streamBudget != 0 && command != "-e")
+    {
+        std::cerr << "Error: --stream only works with -e\n";
+        return -1;
+    }
+    if (options.irText && command != "-i")
+    {
+        std::cerr << "Error: --ir-text only works with -i\n";
+        return -1;
+    }
+    if (options.statistics && command != "-t" && command != "-v")
+    {
+        std::cerr << "Error: --stats only works with -t and -v\n";
+        return -1;
+    }
+    if (options.format != FORMAT_TEXT && ((command != "-e" && command != "-t") || options.streamBudget != 0))
+    {
+        std::cerr << "Error: --format only works with -e and -t, without --stream\n";
+        return -1;
+    }
+    if (options.similarity != 0 && command != "-t" && command != "-v")
+    {
+        std::cerr << "Error: --similar only works with -t and -v\n";
+        return -1;
+    }
+    if ((workerOption || options.isolate == false) && command != "-t" && command != "-v")
+    {
+        std::cerr << "Error: --timeout, --memory and --in-process only work with -t and -v\n";
+        return -1;
+    }
+    if (workerOption && options.isolate == false)
+    {
+        std::cerr << "Error: --timeout and --memory need worker processes, not --in-process\n";
+        return -1;
+    }
+
+    // Only what the command reports is worked out, -c and -v write
+    // Halstead's of the file and each subroutine, -m has no errors and -e
+    // has no use lists
+    if (command[1] == 'c' || command[1] == 'v') options.outputs = OUTPUT_FUNCTIONS;
+    else if (command[1] == 'm') options.outputs = OUTPUT_USAGE;
+    else if (command[1] == 'e') options.outputs = OUTPUT_DIAGNOSTICS;
+    else if (command[1] == 'i') options.outputs = OUTPUT_ALL | OUTPUT_FUNCTIONS | OUTPUT_IR;  // Loaded IR can serve any command
+    if (options.irText) options.outputs |= OUTPUT_IR_TEXT;
+    if (options.statistics) options.outputs |= OUTPUT_DIAGNOSTICS;  // Error counts are part of the statistics
+    if (options.similarity != 0) options.outputs |= OUTPUT_SIMILARITY;
+
+    // Commands: -h help, -m print metrics to console, -e print errors to console
+    // -r print report, -t reads folder for all .s files and makes reports
+    // -c makes csv individual file -v reads a folder of .s files and makes csv files
+    switch(command[1]) 
+    {
+        case 'h':
+            std::cout << "commands:\n";
+            std::cout << "  -h\t\tDisplay help message\n";
+            std::cout << "  -m\t\tPrint metrics to terminal\n";
+            std::cout << "  -e\t\tPrint errors to terminal\n";
+            std::cout << "  -r\t\tCreate report file\n";
+            std::cout << "  -c\t\tCreate csv file\n";
+            std::cout << "  -i\t\tCreate binary IR file, which AEC and other tools can read in place of the .s file\n";
+            std::cout << "  <folder path> -t\t\tCreate report files from folder\n";
+            std::cout << "  <folder path> -v\t\tCreate csv files from folder\n";
+            std::cout << "  <folder path> -p\t\tCreate report files from a folder of files that make one program\n";
+            std::cout << "  <file or folder> --precheck\tOnly check for catastrophic errors\n";
+            std::cout << "  --lsp [options]\tRun as a language server on stdin and stdout, publishing errors as diagnostics\n";
+            std::cout << "options:\n";
+            std::cout << "  --isa=arm32|thumb|aarch64\tInstruction set of the files, detected from directives if not given\n";
+            std::cout << "  --rules=<file>\t\tRules file, lines of: enable|disable <rule>, unwanted <instructions>,\n";
+            std::cout << "\t\t\trestricted <registers>, string-exception <labels>\n";
+            std::cout << "  --stream[=<instructions>]\tWith -e, check and print errors a window of labels at a time\n";
+            std::cout << "\t\t\tso memory use stays bounded, 4096 instructions by default\n";
+            std::cout << "  --ir-text\t\tWith -i, also write the analyzed text and its lines, for tools that show them\n";
+            std::cout << "  --stats\t\tWith -t or -v, also write corpus totals and quantiles to AEC_Statistics.txt\n";
+            std::cout << "  --time=text|iso|epoch\tWrite file times like ctime, as ISO-8601 or as seconds since 1970\n";
+            std::cout << "  --format=text|sarif|junit\tWith -e, print the errors as a SARIF or JUnit XML document,\n";
+            std::cout << "\t\t\twith -t, write one for the whole folder to AEC_Results.sarif or .xml\n";
+            std::cout << "  --similar[=<percent>]\tWith -t or -v, also write pairs of files sharing at least this many\n";
+            std::cout << "\t\t\tcode fingerprints to AEC_Similarity.txt, 50 by default\n";
+            std::cout << "  --timeout=<seconds>\tWith -t or -v, time each file gets before it is recorded as failed,\n";
+            std::cout << "\t\t\t60 by default, 0 for no limit\n";
+            std::cout << "  --memory=<MB>\t\tWith -t or -v, memory each file gets, 4096 by default, 0 for no limit\n";
+            std::cout << "  --in-process\t\tWith -t or -v, analyze files on threads of AEC itself instead of in\n";
+            std::cout << "\t\t\tworker processes, where a file that crashes only loses itself\n";
+            std::cout << "rules:\n ";
+            for (int rule = 0; rule < RULE_COUNT; rule++) std::cout << " " << ruleNames[rule];
+            std::cout << "\n";
+
+            return 0;
+
+        case 'm': // Print to console
+            fileReader(input_file, output_file, 1, options);
+            return 0;
+
+        case 'e': // Print to console
+            fileReader(input_file, output_file, 2, options);
+            return 0;
+
+        case 'r': // Print to file
+            std::filesystem::create_directory("Reports");
+            fileReader(input_file, output_file, 3, options);
+
+            return 0;
+
+        case 'i': // Binary IR file
+            std::filesystem::create_directory("IR");
+            output_file = "IR/" + std::filesystem::path(input_file).stem().string() + ".aecir";
+            fileReader(input_file, output_file, 5, options);
+
+            return 0;
+
+        case 't':
+            // Makes a folder within the directory
+            if (options.format == FORMAT_TEXT) std::filesystem::create_directory("Reports");
+
+            // Reads, analyzes and reports every .s file of the folder
+            corpusReader(input_file, 3, options);
+
+            return 0;
+
+        case 'c':
+            output_file = "AEC_Dataset.csv";
+            fileReader(input_file, output_file, 4, options);
+
+            return 0;
+
+        case 'v':
+            // Reads and analyzes every .s file of the folder into one csv file
+            corpusReader(input_file, 4, options);
+
+            return 0;
+
+        case 'p':
+            // Every file in the folder is part of one program, so labels
+            // can be shared between them with .global
+            std::filesystem::create_directory("Reports");
+            projectReader(input_file, options);
+
+            return 0;
+
+        case '-':
+            if (command == "--precheck")
+            {
+                options.outputs = 0;
+                return precheckReader(input_file, options);
+            }
+            if (command == "--lsp") return lspServer(options);
+            std::cerr << "Error: AEC <filename> -h for help\n";
+
+            return -1;
+
+        default:
+            std::cerr << "Error: AEC <filename> -h for help\n";
+
+            return -1;
+    }
+
+    return 0;
+}
+#endif
+
+/***************************************************************************
+ * filereader takes a file and command given by main to begin analysis of
+ * that .s file. filereader operates by turning lines into tokens which
+ * can be used to determine if errors have occured or to determine
+ * statistical data about the file. filereader then reports the data
+ * determined by the variable "command" */
+void fileReader(std::string input_file, std::string output_file, int command, const AnalysisOptions& options) {
+    FileAnalysis result;
+
+    // -e with --format writes one SARIF or JUnit document instead of text
+    if (command == 2 && options.format != FORMAT_TEXT)
+    {
+        DiagnosticWriter writer(std::cout, options.format);
+        FileAnalysis gate;
+        writer.begin();
+        if (precheckFile(input_file, gate) && (gate.dataExists == false || gate.globalErrorFlag == true))
+        {
+            writer.file(gate);
+        }
+        else
+        {
+            if (!analyzeFile(input_file, result, options)) exit(-1);
+            finishAnalysis(result, nullptr);
+            writer.file(result);
+        }
+        writer.end();
+        return;
+    }
+
+    // Errors and reports are replaced by the catastrophic error when there
+    // is one, so those files are rejected before they are analyzed
+    if (command == 2 || command == 3)
+    {
+        FileAnalysis gate;
+        bool decided = precheckFile(input_file, gate);
+        gate.timeFormat = options.timeFormat;
+        if (decided && (gate.dataExists == false || gate.globalErrorFlag == true))
+        {
+            writeResults(gate, output_file, command);
+            return;
+        }
+
+        /*******************************************************************
+         * Streaming mode prints the errors of each window of labels as soon
+         * as they are known. Files the precheck can't decide use includes
+         * or macros, which are expanded in memory, so they aren't streamed. */
+        if (command == 2 && options.streamBudget != 0 && decided)
+        {
+            result.inputFile = input_file;
+            result.streamBudget = options.streamBudget;
+            result.timeFormat = options.timeFormat;
+            writeMetadata(result, std::cout);
+            std::cout << "********************************************************\nErrors found:\n";
+
+            if (!analyzeFile(input_file, result, options)) exit(-1);
+            finishAnalysis(result, nullptr);
+            writeErrors(result, std::cout, true);
+            std::cout << "********************************************************\n";
+            return;
+        }
+    }
+
+    if (!analyzeFile(input_file, result, options)) exit(-1);
+    if (command != 5) finishAnalysis(result, nullptr);  // The IR keeps the lines, it is finished when loaded
+    writeResults(result, output_file, command);
+}
+
+/***************************************************************************
+ * corpusReader reports every .s file of a folder, for -t and -v. Reading a
+ * file, analyzing it and writing its report happen on separate threads so
+ * that waiting on the disk overlaps with analysis: a group of reader
+ * threads keeps many files and their metadata loading at once, analysis
+ * threads work on files that are in memory and this thread writes the
+ * results in folder order. Readers never get more than a window of files
+ * ahead of the writer, so memory stays bounded on any size of folder.
+ * Unless options.isolate is off, each analysis thread sends the files it
+ * is given to a worker process of its own, already read, over a pipe. */
+void corpusReader(std::string directory, int command, const AnalysisOptions& options) {
+    struct CorpusFile
+    {
+        std::string path, output, contents;
+        FileAnalysis result;
+        bool opened = false;
+        int stage = 0;      // 0 waiting, 1 read, 2 analyzed
+    };
+    std::vector<CorpusFile> files;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::thread> threads;
+    size_t nextRead = 0, nextAnalysis = 0, written = 0;
+    size_t analyzers = std::max(1u, std::thread::hardware_concurrency());
+    size_t readers = 8, window = 4 * (analyzers + readers);
+    std::vector<CorpusStatistics> threadStats(analyzers);
+    std::vector<SimilarityIndex> threadIndex(analyzers);
+    std::ofstream document;
+    std::unique_ptr<DiagnosticWriter> writer;   // -t with --format writes one document for the folder
+    std::string documentName = options.format == FORMAT_SARIF ? "AEC_Results.sarif" : "AEC_Results.xml";
+    std::vector<uint32_t> fingerprintCount;
+
+    for (auto& file : assemblyFiles(directory, command != 5)) 
+    {
+        files.emplace_back();
+        files.back().path = file.path.string();
+        files.back().output = command == 4 ? "AEC_Dataset.csv" : "Reports/" + file.path.stem().string() + "_report.txt";
+        files.back().result.times = file.times;
+    }
+    fingerprintCount.resize(files.size());
+
+    // The spawner of the workers is forked before any thread is started. A
+    // worker or this process writing to a pipe whose reader is gone
+    // shouldn't be stopped by it.
+    std::unique_ptr<WorkerPool> pool;
+    if (options.isolate)
+    {
+        signal(SIGPIPE, SIG_IGN);
+        pool.reset(new WorkerPool(analyzers, command, options));
+        for (size_t t = 0; t < analyzers; t++) pool->start(t);
+    }
+    if (command == 3 && options.format != FORMAT_TEXT)
+    {
+        document.open(documentName);
+        writer.reset(new DiagnosticWriter(document, options.format));
+        writer->begin();
+    }
+
+    for (size_t t = 0; t < readers; t++)
+    {
+        threads.emplace_back([&]()
+        {
+            while (true)
+            {
+                size_t i;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&]() { return nextRead >= files.size() || nextRead < written + window; });
+                    if (nextRead >= files.size()) return;
+                    i = nextRead++;
+                }
+
+                CorpusFile& file = files[i];
+                std::ifstream infile(file.path, std::ios::binary);
+                if (infile.is_open())
+                {
+                    file.contents.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+                    file.opened = true;
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+                file.stage = 1;
+                changed.notify_all();
+            }
+        });
+    }
+
+    for (size_t t = 0; t < analyzers; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            while (true)
+            {
+                size_t i;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    if (nextAnalysis >= files.size()) return;
+                    i = nextAnalysis++;
+                    changed.wait(guard, [&]() { return files[i].stage == 1; });
+                }
+
+                CorpusFile& file = files[i];
+                if (pool != nullptr)
+                {
+                    FileTimes times = file.result.times;
+                    pool->analyze(t, file.path, file.opened ? &file.contents : nullptr, file.result);
+                    file.result.times = times;
+                }
+                else if (!analyzeCorpusFile(file.path, command, options, file.opened ? &file.contents : nullptr, file.result))
+                {
+                    exit(-1);
+                }
+                file.contents = std::string();
+
+                if (options.statistics)
+                {
+                    threadStats[t].add(file.result);
+                }
+                if (options.similarity != 0)
+                {
+                    threadIndex[t].add(i, file.result.fingerprints);
+                    fingerprintCount[i] = file.result.fingerprints.size();
+                    file.result.fingerprints = std::vector<uint64_t>();
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+                file.stage = 2;
+                changed.notify_all();
+            }
+        });
+    }
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return files[i].stage == 2; });
+        }
+
+        if (writer != nullptr) writer->file(files[i].result);
+        else writeResults(files[i].result, files[i].output, command);
+
+        std::lock_guard<std::mutex> guard(lock);
+        files[i].result = FileAnalysis();
+        written++;
+        changed.notify_all();
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    pool.reset();
+    if (writer != nullptr)
+    {
+        writer->end();
+        std::cout << "Created results file: " << documentName << std::endl;
+    }
+
+    if (options.statistics)
+    {
+        for (size_t t = 1; t < analyzers; t++)
+        {
+            threadStats[0].merge(threadStats[t]);
+        }
+        writeStatistics(threadStats[0], "AEC_Statistics.txt");
+        std::cout << "Created statistics file: AEC_Statistics.txt" << std::endl;
+    }
+    if (options.similarity != 0)
+    {
+        std::vector<std::string> paths;
+        for (auto& file : files) paths.push_back(file.path);
+        for (size_t t = 1; t < analyzers; t++)
+        {
+            threadIndex[0].merge(threadIndex[t]);
+        }
+        writeSimilarity(threadIndex[0], paths, fingerprintCount, options.similarity, "AEC_Similarity.txt");
+        std::cout << "Created similarity file: AEC_Similarity.txt" << std::endl;
+    }
+}
+
+/***************************************************************************
+ * analyzeCorpusFile analyzes one file of a folder for -t and -v. Reports
+ * are replaced by the catastrophic error when there is one, so with -t
+ * those files are only prechecked. Returns false if the file can't be read. */
+bool analyzeCorpusFile(const std::string& path, int command, const AnalysisOptions& options, const std::string* contents, FileAnalysis& result) {
+    FileAnalysis gate;
+    gate.times = result.times;
+    gate.timeFormat = options.timeFormat;
+
+    if (command == 3 && precheckFile(path, gate, contents) && (gate.dataExists == false || gate.globalErrorFlag == true))
+    {
+        result = gate;
+        return true;
+    }
+    if (!analyzeFile(path, result, options, contents)) return false;
+    finishAnalysis(result, nullptr);
+    return true;
+}
+
+/***************************************************************************
+ * The pool has to be made while this process has one thread, for the
+ * spawner is forked here. If it can't be, no worker can be started and
+ * every file is recorded as failed. */
+WorkerPool::WorkerPool(size_t count, int kind, const AnalysisOptions& given) : workers(count), command(kind), options(given) {
+    int ends[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) return;
+    spawner = fork();
+    if (spawner == 0)
+    {
+        close(ends[0]);
+        runSpawner(ends[1], command, options);
+    }
+    close(ends[1]);
+    if (spawner < 0) close(ends[0]);
+    else control = ends[0];
+}
+
+/***************************************************************************
+ * start has the spawner fork worker w and takes this process's ends of
+ * its pipes. Returns false if it couldn't be started. */
+bool WorkerPool::start(size_t w) {
+    std::lock_guard<std::mutex> guard(lock);
+    int32_t request = 0;    // 0 starts a worker
+    pid_t pid = -1;
+    int ends[2];
+    char space[CMSG_SPACE(sizeof(ends))];
+    iovec data = {&pid, sizeof(pid)};
+    msghdr message = {};
+    ssize_t got;
+
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = space;
+    message.msg_controllen = sizeof(space);
+    if (control < 0 || !writeAll(control, &request, sizeof(request))) return false;
+    while ((got = recvmsg(control, &message, 0)) < 0 && errno == EINTR) {}
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (got != sizeof(pid) || pid <= 0 || header == nullptr || header->cmsg_level != SOL_SOCKET ||
+        header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(ends)))
+    {
+        return false;
+    }
+    std::memcpy(ends, CMSG_DATA(header), sizeof(ends));
+    workers[w].pid = pid;
+    workers[w].requests = ends[0];
+    workers[w].replies = ends[1];
+    return true;
+}
+
+/***************************************************************************
+ * reap has the spawner wait for a worker to end. Returns how it ended, as
+ * waitpid gives it, 0 if the spawner is gone. */
+int WorkerPool::reap(pid_t pid) {
+    int32_t request = pid;
+    int status = 0;
+
+    if (control >= 0 && writeAll(control, &request, sizeof(request))) readAll(control, &status, sizeof(status));
+    return status;
+}
+
+/***************************************************************************
+ * stop kills worker w if it is still running and reaps it. Returns how it
+ * ended, as waitpid gives it. */
+int WorkerPool::stop(size_t w) {
+    std::lock_guard<std::mutex> guard(lock);
+    Worker& worker = workers[w];
+
+    if (worker.pid < 0) return 0;
+    close(worker.requests);
+    close(worker.replies);
+    kill(worker.pid, SIGKILL);
+    int status = reap(worker.pid);
+    worker = Worker();
+    return status;
+}
+
+// Closing the pipes lets every worker finish its loop and exit on its own,
+// then closing the socket lets the spawner exit
+WorkerPool::~WorkerPool() {
+    for (auto& worker : workers)
+    {
+        if (worker.pid < 0) continue;
+        close(worker.requests);
+        close(worker.replies);
+        reap(worker.pid);
+    }
+    if (spawner < 0) return;
+    close(control);
+    int status;
+    while (waitpid(spawner, &status, 0) < 0 && errno == EINTR) {}
+}
+
+/***************************************************************************
+ * analyze has worker w analyze the file at path, whose contents were
+ * read already unless they are nullptr. If the worker dies first result
+ * only gets the path and why it failed. */
+void WorkerPool::analyze(size_t w, const std::string& path, const std::string* contents, FileAnalysis& result) {
+    AnalysisArchive archive;
+    uint64_t sizes[2] = {path.size(), contents != nullptr ? contents->size() : UINT64_MAX};    // UINT64_MAX if not read
+    uint64_t size;
+
+    archive.reading = true;
+    if (workers[w].pid >= 0 || start(w))
+    {
+        Worker& worker = workers[w];
+        if (writeAll(worker.requests, sizes, sizeof(sizes)) && writeAll(worker.requests, path.data(), path.size()) &&
+            (contents == nullptr || writeAll(worker.requests, contents->data(), contents->size())) &&
+            readAll(worker.replies, &size, sizeof(size)))
+        {
+            archive.bytes.resize(size);
+            if (readAll(worker.replies, &archive.bytes[0], size))
+            {
+                archive.field(result);
+                if (!archive.failed) return;
+            }
+        }
+    }
+
+    result = FileAnalysis();
+    result.inputFile = path;
+    result.timeFormat = options.timeFormat;
+    if (workers[w].pid < 0)
+    {
+        result.failure = "no worker process could be started";
+        return;
+    }
+    int status = stop(w);
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM)
+    {
+        result.failure = "it took longer than " + std::to_string(options.timeLimit) + (options.timeLimit == 1 ? " second" : " seconds");
+    }
+    else if (WIFSIGNALED(status) && WTERMSIG(status) != SIGKILL)
+    {
+        result.failure = "the worker crashed with signal " + std::to_string(WTERMSIG(status));
+    }
+    else if (WIFEXITED(status))
+    {
+        result.failure = "the worker exited with code " + std::to_string(WEXITSTATUS(status));
+    }
+    else
+    {
+        result.failure = "the worker stopped answering";
+    }
+}
+
+/***************************************************************************
+ * runSpawner is the loop of the spawner process. Asked for a worker, it
+ * forks one and sends back its pid with the other ends of the worker's
+ * pipes, or -1 and no pipes; asked with a pid, it reaps that worker and
+ * sends back how it ended. It exits once its socket is closed. Never
+ * returns. */
+void runSpawner(int control, int command, const AnalysisOptions& options) {
+    int32_t request;
+
+    while (readAll(control, &request, sizeof(request)))
+    {
+        if (request != 0)
+        {
+            int status = 0;
+            while (waitpid(request, &status, 0) < 0 && errno == EINTR) {}
+            if (!writeAll(control, &status, sizeof(status))) break;
+            continue;
+        }
+
+        int requests[2] = {-1, -1}, replies[2] = {-1, -1};
+        pid_t pid = -1;
+        if (pipe(requests) == 0 && pipe(replies) == 0) pid = fork();
+        if (pid == 0)
+        {
+            close(control);
+            close(requests[1]);
+            close(replies[0]);
+            runWorker(requests[0], replies[1], command, options);
+        }
+
+        int ends[2] = {requests[1], replies[0]};
+        char space[CMSG_SPACE(sizeof(ends))] = {};
+        iovec data = {&pid, sizeof(pid)};
+        msghdr message = {};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        if (pid > 0)
+        {
+            message.msg_control = space;
+            message.msg_controllen = sizeof(space);
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(ends));
+            std::memcpy(CMSG_DATA(header), ends, sizeof(ends));
+        }
+        ssize_t sent;
+        while ((sent = sendmsg(control, &message, 0)) < 0 && errno == EINTR) {}
+        for (int end : {requests[0], requests[1], replies[0], replies[1]})
+        {
+            if (end >= 0) close(end);
+        }
+        if (sent != sizeof(pid)) break;
+    }
+    while (wait(nullptr) > 0 || errno == EINTR) {}
+    _exit(0);
+}
+
+/***************************************************************************
+ * runWorker is the loop of a worker process: it reads a file, analyzes
+ * it and writes back the analysis until its pipe is closed. A file is
+ * sent as its path and contents, or only its path if it couldn't be read,
+ * in which case the worker tries itself. The
+ * time limit is an alarm, whose signal ends the worker. The memory limit
+ * is on top of what the worker already has mapped, as it was forked from
+ * AEC, and running out is sent back as a failure. Never returns. */
+void runWorker(int requests, int replies, int command, const AnalysisOptions& options) {
+    std::string path, contents, bytes;
+    uint64_t sizes[2], size;
+
+    if (options.memoryLimit != 0)
+    {
+        long pages = 0;
+        std::ifstream("/proc/self/statm") >> pages;
+        rlim_t allowed = rlim_t(pages) * sysconf(_SC_PAGESIZE) + (rlim_t(options.memoryLimit) << 20);
+        rlimit limit = {allowed, allowed};
+        setrlimit(RLIMIT_AS, &limit);
+    }
+
+    while (readAll(requests, sizes, sizeof(sizes)))
+    {
+        bool read = sizes[1] != UINT64_MAX;
+        path.resize(sizes[0]);
+        contents.resize(read ? sizes[1] : 0);
+        if (!readAll(requests, &path[0], path.size()) || !readAll(requests, &contents[0], contents.size())) break;
+
+        alarm(options.timeLimit);
+        try
+        {
+            FileAnalysis result;
+            AnalysisArchive archive;
+            if (!analyzeCorpusFile(path, command, options, read ? &contents : nullptr, result)) result.failure = "it could not be read";
+            archive.field(result);
+            bytes = std::move(archive.bytes);
+        }
+        catch (const std::exception& error)
+        {
+            FileAnalysis result;
+            AnalysisArchive archive;
+            result.inputFile = path;
+            result.timeFormat = options.timeFormat;
+            if (dynamic_cast<const std::bad_alloc*>(&error) != nullptr)
+            {
+                result.failure = "it needed more than " + std::to_string(options.memoryLimit) + " MB";
+            }
+            else
+            {
+                result.failure = std::string("it stopped on an exception: ") + error.what();
+            }
+            archive.field(result);
+            bytes = std::move(archive.bytes);
+        }
+        alarm(0);
+
+        size = bytes.size();
+        if (!writeAll(replies, &size, sizeof(size)) || !writeAll(replies, bytes.data(), bytes.size())) break;
+        bytes = std::string();
+        contents = std::string();
+    }
+    _exit(0);   // Never flush the streams this process was forked with
+}
+
+/***************************************************************************
+ * readAll and writeAll move size bytes through a pipe, however many reads
+ * or writes that takes. Return false if the other end is closed. */
+bool readAll(int fd, void* data, size_t size) {
+    char* at = static_cast<char*>(data);
+    while (size > 0)
+    {
+        ssize_t got = read(fd, at, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        at += got;
+        size -= got;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+    const char* at = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        ssize_t put = write(fd, at, size);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        at += put;
+        size -= put;
+    }
+    return true;
+}
+
+/***************************************************************************
+ * The fields of a FileAnalysis a worker sends back, or the binary IR keeps
+ * besides its records. The instructions, label index and text are only
+ * needed while the file is analyzed. */
+void AnalysisArchive::field(FunctionMetrics& function) {
+    field(function.name);
+    field(function.line);
+    field(function.totalOperators);
+    field(function.totalOperands);
+    field(function.cyclomatic);
+    uses(function.operators, owner->uniqueOperators);
+    uses(function.operands, owner->uniqueOperands);
+    field(function.uniqueOperatorCount);
+    field(function.uniqueOperandCount);
+    field(function.length);
+    field(function.vocabulary);
+    field(function.volume);
+    field(function.difficulty);
+    field(function.effort);
+}
+
+// Uses of a function that isn't folded yet are kept as where their name is in the file's set sorted, and
+// point into the set again when read
+void AnalysisArchive::uses(std::vector<const std::string*>& list, const std::unordered_set<std::string>& names) {
+    SortedNames& order = sorted[&names];
+    if (order.names.size() != names.size())
+    {
+        for (auto& name : names) order.names.push_back(&name);
+        std::sort(order.names.begin(), order.names.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+        for (uint32_t i = 0; !reading && i < order.names.size(); i++) order.index[order.names[i]] = i;
+    }
+    size_t size = count(list.size());
+    for (size_t i = 0; !reading && i < size; i++)
+    {
+        auto found = names.find(*list[i]);
+        uint32_t at = found != names.end() ? order.index[&*found] : 0;
+        field(at);
+    }
+    for (size_t i = 0; reading && i < size && !failed; i++)
+    {
+        uint32_t at = 0;
+        field(at);
+        if (at >= order.names.size()) failed = true;
+        else list.push_back(order.names[at]);
+    }
+}
+
+void AnalysisArchive::field(FileAnalysis& result) {
+    owner = &result;
+    field(result.inputFile);
+    choice(result.isa, ISA_AARCH64 + 1);
+    field(result.model);
+    field(result.uniqueOperands);
+    field(result.uniqueOperators);
+    field(result.subroutines);
+    field(result.registerUse);
+    if (!skipRecords) field(result.labels);
+    field(result.variables);
+    field(result.constants);
+    field(result.variableLineNum);
+    field(result.constantLineNum);
+    field(result.globals);
+    field(result.fingerprints);
+    for (auto list : findingLists)
+    {
+        if (!skipRecords) field(result.*list);
+    }
+    for (auto list : {&FileAnalysis::unusedLabel, &FileAnalysis::unusedVariable, &FileAnalysis::unusedConstant,
+        &FileAnalysis::noReturnError, &FileAnalysis::lrSaveError, &FileAnalysis::branchOutError, &FileAnalysis::registerError,
+        &FileAnalysis::deadStoreError, &FileAnalysis::stackError, &FileAnalysis::callGraphUse, &FileAnalysis::badBranchTarget})
+    {
+        field(result.*list);
+    }
+    for (auto& lines : result.addressLines) field(lines);
+    if (!skipRecords) field(result.labelLineNum);
+    for (auto list : {&FileAnalysis::returnLineNum, &FileAnalysis::blCallLineNum, &FileAnalysis::lrSaveLineNum,
+        &FileAnalysis::badBranchLineNum})
+    {
+        field(result.*list);
+    }
+    if (!skipRecords) field(result.directiveUse);
+    field(result.functions);
+    if (!skipRecords) field(result.sourceFiles);
+    if (!skipRecords) field(result.sourceMap);
+    field(result.preprocessorUses);
+    for (auto count : {&FileAnalysis::fullCommentLines, &FileAnalysis::blankLines, &FileAnalysis::totalLines,
+        &FileAnalysis::linesWComment, &FileAnalysis::linesWOComment, &FileAnalysis::dirLines, &FileAnalysis::totalOperators,
+        &FileAnalysis::totalOperands, &FileAnalysis::cyclomatic, &FileAnalysis::dataLineNum, &FileAnalysis::pushNum,
+        &FileAnalysis::popNum, &FileAnalysis::length, &FileAnalysis::vocabulary})
+    {
+        field(result.*count);
+    }
+    choice(result.timeFormat, TIME_EPOCH + 1);
+    field(result.exitExists);
+    field(result.dataExists);
+    field(result.globalErrorFlag);
+    field(result.enabledRules);
+    field(result.outputs);
+    field(result.times);
+    field(result.volume);
+    field(result.difficulty);
+    field(result.effort);
+    field(result.failure);
+}
+
+/***************************************************************************
+ * analyzeFile opens the file and picks the instruction set profile, either
+ * the one asked for with --isa or the one its directives point to. The
+ * analyzer built for that profile then reads the file. Returns false if
+ * the file can't be read. */
+bool analyzeFile(const std::string& input_file, FileAnalysis& result, const AnalysisOptions& options, const std::string* contents) {
+    IsaProfile isa = options.isa;
+    std::ifstream file;
+    MemoryBuffer memory(contents);
+    std::istream infile(&memory);
+    IrFile ir;
+
+    // A binary IR file is mapped and the analysis is rebuilt from its
+    // records, the instruction set is the one it was written for
+    if (contents == nullptr && std::filesystem::path(input_file).extension() == ".aecir")
+    {
+        if (!openIr(input_file, ir))
+        {
+            std::cerr << "Error: Not a binary IR file of this version: " << input_file << "\n";
+            return false;
+        }
+        if (!loadIr(ir, result))
+        {
+            std::cerr << "Error: Broken binary IR file: " << input_file << "\n";
+            return false;
+        }
+        result.inputFile = input_file;
+        result.outputs = options.outputs;
+        result.enabledRules = options.outputs & OUTPUT_DIAGNOSTICS ? options.rules.enabled & result.enabledRules : 0;
+        result.timeFormat = options.timeFormat;
+        return true;
+    }
+    // The corpus pipeline has already read the file into memory
+    else if (contents == nullptr)
+    {
+        file.open(input_file);
+        if (!file.is_open())  // Check if file successfully opened
+        {
+            std::cerr << "Error: Failed to open file: " << input_file;
+            return false;
+        }
+        infile.rdbuf(file.rdbuf());
+    }
+
+    result.inputFile = input_file;
+    result.outputs = options.outputs;
+    result.enabledRules = options.outputs & OUTPUT_DIAGNOSTICS ? options.rules.enabled : 0;
+    result.timeFormat = options.timeFormat;
+
+    // Files with macros, includes or conditional assembly are analyzed as
+    // expanded text, every other file is read straight from disk
+    std::string expanded;
+    std::istringstream expandedStream;
+    std::istream* text = &infile;
+    if (result.streamBudget == 0 && preprocessFile(infile, result, options.includes, expanded, *options.log))
+    {
+        expandedStream.str(expanded);
+        text = &expandedStream;
+    }
+
+    // The binary IR keeps the text that was analyzed with --ir-text
+    MemoryBuffer sourceMemory(nullptr);
+    std::istream sourceStream(&sourceMemory);
+    if (result.outputs & OUTPUT_IR_TEXT)
+    {
+        result.sourceText.assign(std::istreambuf_iterator<char>(*text), std::istreambuf_iterator<char>());
+        sourceMemory = MemoryBuffer(&result.sourceText);
+        sourceStream.rdbuf(&sourceMemory);
+        text = &sourceStream;
+    }
+
+    if (isa == ISA_DETECT) isa = detectIsa(*text);
+    result.isa = isa;
+
+    LineAnalyzer analyze = analyzerFor(isa, options.rules);
+
+    // Very large files are split at their labels and analyzed on every core
+    if (result.streamBudget == 0 && std::thread::hardware_concurrency() > 1 &&
+        (contents != nullptr ? contents->size() : std::filesystem::file_size(input_file)) >= parallelFileSize)
+    {
+        if (result.outputs & OUTPUT_IR_TEXT) expanded.swap(result.sourceText);    // Already read for the IR
+        else if (text == &infile) expanded.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+        analyzeChunks(expanded, result, analyze);
+        if (result.outputs & OUTPUT_IR_TEXT) expanded.swap(result.sourceText);
+    }
+    else
+    {
+        analyze(*text, result, ChunkStart());
+    }
+    return true;
+}
+
+/***************************************************************************
+ * analyzerFor picks the analyzer built for an instruction set profile. */
+LineAnalyzer analyzerFor(IsaProfile isa, const RuleSet& rules) {
+    switch (isa)
+    {
+        case ISA_THUMB:
+            return [&rules](std::istream& in, FileAnalysis& part, const ChunkStart& start) { analyzeLines<Thumb>(in, part, rules, start); };
+        case ISA_AARCH64:
+            return [&rules](std::istream& in, FileAnalysis& part, const ChunkStart& start) { analyzeLines<AArch64>(in, part, rules, start); };
+        default:
+            return [&rules](std::istream& in, FileAnalysis& part, const ChunkStart& start) { analyzeLines<Arm32>(in, part, rules, start); };
+    }
+}
+
+/***************************************************************************
+ * analyzeIncremental analyzes the text of a file like analyzeFile, reusing
+ * what the cache kept from the last time. The file is split at every
+ * label it can be split at, and only regions whose text or starting
+ * section changed are read again. A region that only moved has its lines
+ * shifted, it is not read again.
+ * The checks that need the whole file run on the merged result as usual,
+ * from the kept register events, with no tokenizing. Files with macros
+ * or includes are analyzed whole. */
+void analyzeIncremental(const std::string& input_file, const std::string& contents, IncrementalAnalysis& cache,
+    FileAnalysis& result, const AnalysisOptions& options) {
+    std::string expanded;
+    std::istringstream probe(contents);
+    std::vector<size_t> offsets;
+    std::vector<ChunkStart> starts;
+    std::vector<IncrementalRegion*> regions;
+    std::vector<size_t> missing;
+
+    result.inputFile = input_file;
+    result.outputs = options.outputs;
+    result.enabledRules = options.outputs & OUTPUT_DIAGNOSTICS ? options.rules.enabled : 0;
+    bool directives = contents.find(".include") != std::string::npos || contents.find(".macro") != std::string::npos ||
+        contents.find(".rept") != std::string::npos || contents.find(".if") != std::string::npos;
+    if (directives && preprocessFile(probe, result, options.includes, expanded, *options.log))
+    {
+        cache = IncrementalAnalysis();
+        result = FileAnalysis();
+        analyzeFile(input_file, result, options, &contents);
+        return;
+    }
+    result.isa = options.isa == ISA_DETECT ? detectIsa(probe) : options.isa;
+    if (result.isa != cache.isa || result.outputs != cache.outputs || result.enabledRules != cache.enabledRules)
+    {
+        cache = IncrementalAnalysis();
+        cache.isa = result.isa;
+        cache.outputs = result.outputs;
+        cache.enabledRules = result.enabledRules;
+    }
+    cache.generation++;
+
+    // Regions are split at labels at least this far apart, a handful of lines
+    splitAtLabels(contents, 256, offsets, starts);
+    for (size_t i = 0; i < starts.size(); i++)
+    {
+        uint64_t key = std::hash<std::string_view>()(std::string_view(contents).substr(offsets[i], offsets[i + 1] - offsets[i]));
+        IncrementalRegion& region = cache.regions[key * 4 + starts[i].dataFlag * 2 + starts[i].globalFlag];
+        if (region.generation == 0) missing.push_back(i);
+        region.generation = cache.generation;
+        regions.push_back(&region);
+    }
+    cache.reread = missing.size();
+
+    LineAnalyzer analyze = analyzerFor(result.isa, options.rules);
+    parallelFor(missing.size(), [&](size_t m)
+    {
+        size_t i = missing[m];
+        ChunkStart start = starts[i];
+        std::istringstream in(contents.substr(offsets[i], offsets[i + 1] - offsets[i]));
+        FileAnalysis& part = regions[i]->part;
+        regions[i]->line = start.line;
+        part.outputs = result.outputs;
+        part.enabledRules = result.enabledRules;
+        analyze(in, part, start);
+    });
+
+    // A text found twice is moved to each place in turn
+    for (size_t i = 0; i < starts.size(); i++)
+    {
+        shiftLines(regions[i]->part, starts[i].line - regions[i]->line);
+        regions[i]->line = starts[i].line;
+        mergeAnalysis(result, regions[i]->part);
+    }
+    for (auto region = cache.regions.begin(); region != cache.regions.end(); )
+    {
+        if (region->second.generation != cache.generation) region = cache.regions.erase(region);
+        else region++;
+    }
+}
+
+/***************************************************************************
+ * shiftLines moves everything a region found down by lines lines, for a
+ * region that was read on its own. */
+void shiftLines(FileAnalysis& part, int lines) {
+    static std::vector<std::string> FileAnalysis::* const messages[] = {
+        &FileAnalysis::stringError, &FileAnalysis::unwantedInstructions, &FileAnalysis::branchUse,
+        &FileAnalysis::svcUse, &FileAnalysis::subroutineUse, &FileAnalysis::isolatedCode,
+        &FileAnalysis::unusedConditional, &FileAnalysis::restrictedError};
+    static std::vector<int> FileAnalysis::* const numbers[] = {
+        &FileAnalysis::labelLineNum, &FileAnalysis::returnLineNum, &FileAnalysis::blCallLineNum,
+        &FileAnalysis::lrSaveLineNum, &FileAnalysis::badBranchLineNum, &FileAnalysis::variableLineNum,
+        &FileAnalysis::constantLineNum};
+    if (lines == 0) return;
+
+    for (auto& function : part.functions) function.line += lines;
+
+    for (auto message : messages)
+    {
+        for (auto& text : part.*message)
+        {
+            size_t found = 0;
+            while ((found = text.find("line ", found)) != std::string::npos)
+            {
+                size_t digits = found + 5, stop = text.find_first_not_of("0123456789", digits);
+                if (stop == std::string::npos) stop = text.size();
+                found = stop;
+                if (stop == digits || stop - digits > 9) continue;
+                std::string shifted = std::to_string(std::stoi(text.substr(digits, stop - digits)) + lines);
+                text.replace(digits, stop - digits, shifted);
+                found = digits + shifted.size();
+            }
+        }
+    }
+    for (auto& modeLines : part.addressLines)
+    {
+        for (auto& line : modeLines) line += lines;
+    }
+    for (auto list : numbers)
+    {
+        for (auto& line : part.*list) line += lines;
+    }
+    for (auto& directive : part.directiveUse)
+    {
+        for (auto& line : directive.second) line += lines;
+    }
+    for (auto& used : part.registerUse)
+    {
+        std::unordered_set<int> shifted;
+        for (int line : used) shifted.insert(line + lines);
+        used = std::move(shifted);
+    }
+    for (auto& instruction : part.code) instruction.line += lines;
+    part.totalLines += lines;
+    if (part.dataLineNum != 0) part.dataLineNum += lines;
+}
+
+/***************************************************************************
+ * splitAtLabels finds where the text of a file can be split at labels, at
+ * least minSize bytes apart. A quick pass over the lines finds the section
+ * each label starts in. Labels right after a cmp, or after an svc with its
+ * operand still to come, are not split at since the next line is checked
+ * against them. offsets gets the start of each piece and the end of the
+ * text, starts the state each piece starts in. */
+void splitAtLabels(const std::string& text, size_t minSize, std::vector<size_t>& offsets, std::vector<ChunkStart>& starts) {
+    ChunkStart state;
+    std::string_view line, token;
+    size_t pos = 0, end;
+    bool carried = false;   // The next operator line is checked against this one
+
+    offsets.assign(1, 0);
+    starts.assign(1, ChunkStart());
+    while (pos < text.size())
+    {
+        end = text.find('\n', pos);
+        if (end == std::string::npos) end = text.size();
+        line = std::string_view(text).substr(pos, end - pos);
+        size_t commentPos = line.find('@');
+        if (commentPos == std::string_view::npos) commentPos = line.find('/');
+        line = line.substr(0, commentPos);  // Get rid of comment
+
+        size_t at = 0;
+        auto next = [&]()
+        {
+            size_t start = line.find_first_not_of(" \t\r\v\f", at);
+            if (start == std::string_view::npos) return false;
+            at = std::min(line.find_first_of(" \t\r\v\f", start), line.size());
+            token = line.substr(start, at - start);
+            return true;
+        };
+        bool first = true;
+
+        while (next())
+        {
+            if (first && token.back() == ':' && state.dataFlag == false)
+            {
+                if (carried == false && pos > offsets.back() && pos >= offsets.back() + minSize)
+                {
+                    offsets.push_back(pos);
+                    starts.push_back(state);
+                }
+                continue;
+            }
+            if (first && token[0] != '.' && token.back() != ':')
+            {   // An operator, the rest of the line are operands
+                carried = token == "cmp" || token == "CMP" ||
+                    ((token.find("svc") != std::string::npos || token.find("SVC") != std::string::npos) && !next());
+                break;
+            }
+            first = false;
+
+            if (token == ".global")
+            {
+                state.globalFlag = true;
+                state.dataFlag = false;
+            }
+            else if (token == ".data") state.dataFlag = true;
+            else if (token == ".text") state.dataFlag = false;
+        }
+
+        state.line++;
+        pos = end + 1;
+    }
+    offsets.push_back(text.size());
+}
+
+/***************************************************************************
+ * analyzeChunks splits the text of a file at labels and analyzes the
+ * pieces at the same time. The pieces are then merged back in order. */
+void analyzeChunks(const std::string& text, FileAnalysis& result, const LineAnalyzer& analyze) {
+    std::vector<size_t> offsets;
+    std::vector<ChunkStart> starts;
+    std::vector<FileAnalysis> chunks;
+
+    splitAtLabels(text, text.size() / (std::thread::hardware_concurrency() * 4) + 1, offsets, starts);
+
+    chunks.resize(starts.size());
+    parallelFor(chunks.size(), [&](size_t i)
+    {
+        std::istringstream in(text.substr(offsets[i], offsets[i + 1] - offsets[i]));
+        chunks[i].outputs = result.outputs;
+        chunks[i].enabledRules = result.enabledRules;
+        analyze(in, chunks[i], starts[i]);
+    });
+
+    for (auto& chunk : chunks)
+    {
+        mergeAnalysis(result, chunk);
+    }
+}
+
+/***************************************************************************
+ * mergeAnalysis adds the analysis of the next piece of a file to what is
+ * known from the pieces before it. Lists are kept in line order. The
+ * piece is left as it was, a cached region is merged again next time. */
+void mergeAnalysis(FileAnalysis& result, const FileAnalysis& chunk) {
+    static std::vector<std::string> FileAnalysis::* const lists[] = {
+        &FileAnalysis::labels, &FileAnalysis::variables, &FileAnalysis::constants, &FileAnalysis::globals,
+        &FileAnalysis::stringError, &FileAnalysis::unwantedInstructions, &FileAnalysis::branchUse,
+        &FileAnalysis::svcUse, &FileAnalysis::subroutineUse, &FileAnalysis::isolatedCode,
+        &FileAnalysis::unusedConditional, &FileAnalysis::restrictedError, &FileAnalysis::badBranchTarget};
+    static std::vector<int> FileAnalysis::* const lineLists[] = {
+        &FileAnalysis::labelLineNum, &FileAnalysis::returnLineNum, &FileAnalysis::blCallLineNum,
+        &FileAnalysis::lrSaveLineNum, &FileAnalysis::badBranchLineNum, &FileAnalysis::variableLineNum,
+        &FileAnalysis::constantLineNum};
+    size_t codeOffset = result.code.size();
+
+    for (auto list : lists)
+    {
+        (result.*list).insert((result.*list).end(), (chunk.*list).begin(), (chunk.*list).end());
+    }
+    for (auto list : lineLists)
+    {
+        (result.*list).insert((result.*list).end(), (chunk.*list).begin(), (chunk.*list).end());
+    }
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+    {
+        result.addressLines[mode].insert(result.addressLines[mode].end(), chunk.addressLines[mode].begin(), chunk.addressLines[mode].end());
+    }
+    for (auto& directive : chunk.directiveUse)
+    {
+        auto& lines = result.directiveUse[directive.first];
+        lines.insert(lines.end(), directive.second.begin(), directive.second.end());
+    }
+    for (size_t r = 0; r < chunk.registerUse.size(); r++)
+    {
+        result.registerUse[r].insert(chunk.registerUse[r].begin(), chunk.registerUse[r].end());
+    }
+    result.uniqueOperands.insert(chunk.uniqueOperands.begin(), chunk.uniqueOperands.end());
+    result.uniqueOperators.insert(chunk.uniqueOperators.begin(), chunk.uniqueOperators.end());
+    result.subroutines.insert(chunk.subroutines.begin(), chunk.subroutines.end());
+    result.code.insert(result.code.end(), chunk.code.begin(), chunk.code.end());
+    result.tokenHashes.insert(result.tokenHashes.end(), chunk.tokenHashes.begin(), chunk.tokenHashes.end());
+    for (const auto& kept : chunk.functions)
+    {
+        // The chunk's strings may be gone with it, so the copy points at the same ones of the file
+        FunctionMetrics function = kept;
+        for (auto& name : function.operators) name = &*result.uniqueOperators.find(*name);
+        for (auto& name : function.operands) name = &*result.uniqueOperands.find(*name);
+        // Code before the chunk's first label is still under the last label of the one before
+        if (function.name.empty() && !result.functions.empty()) result.functions.back().merge(function);
+        else result.functions.push_back(std::move(function));
+    }
+    for (auto& label : chunk.labelIndex)
+    {
+        result.labelIndex[label.first] = label.second + codeOffset;
+    }
+
+    result.model = chunk.model;
+    result.fullCommentLines += chunk.fullCommentLines;
+    result.blankLines += chunk.blankLines;
+    result.linesWComment += chunk.linesWComment;
+    result.linesWOComment += chunk.linesWOComment;
+    result.dirLines += chunk.dirLines;
+    result.totalOperators += chunk.totalOperators;
+    result.totalOperands += chunk.totalOperands;
+    result.cyclomatic += chunk.cyclomatic - 1;  // Both start at 1
+    result.pushNum += chunk.pushNum;
+    result.popNum += chunk.popNum;
+    result.totalLines = chunk.totalLines;
+    if (chunk.dataLineNum != 0) result.dataLineNum = chunk.dataLineNum;
+    result.exitExists = result.exitExists || chunk.exitExists;
+    result.dataExists = result.dataExists || chunk.dataExists;
+    result.globalErrorFlag = result.globalErrorFlag || chunk.globalErrorFlag;
+}
+
+/***************************************************************************
+ * detectIsa looks at the directives before the first instruction for the
+ * instruction set the file is written for, falling back on the registers
+ * the first instruction names. The stream is rewound afterwards. */
+IsaProfile detectIsa(std::istream& infile) {
+    IsaProfile isa = ISA_ARM32;
+    std::string line, token;
+
+    while (std::getline(infile, line))
+    {
+        std::istringstream iss(line);
+        if (!(iss >> token) || token[0] == '@' || token[0] == '/') continue;
+        if (token.back() == ':' && !(iss >> token)) continue;   // Label on its own line
+
+        if (token == ".arch" || token == ".cpu")
+        {
+            iss >> token;
+            if (token.find("armv8") != std::string::npos || token.find("aarch64") != std::string::npos) isa = ISA_AARCH64;
+        }
+        else if (token == ".thumb" || token == ".thumb_func" || (token == ".code" && iss >> token && token == "16"))
+        {
+            isa = ISA_THUMB;
+        }
+        else if (token[0] != '.')
+        {   // The first instruction decides if the directives didn't
+            if (isa == ISA_ARM32 && iss >> token && (token[0] == 'x' || token[0] == 'w') &&
+                token.size() > 1 && std::isdigit(static_cast<unsigned char>(token[1]))) isa = ISA_AARCH64;
+            break;
+        }
+    }
+
+    infile.clear();
+    infile.seekg(0);
+    return isa;
+}
+
+/***************************************************************************
+ * precheckFile looks only at the directives to find the catastrophic
+ * errors, stopping at .data. It follows the analyzer: directives count
+ * anywhere but on an instruction line, after a comment is cut off.
+ * Returns false if the directives alone can't decide, when the file
+ * can't be opened or has .include, .macro or conditional assembly. */
+bool precheckFile(const std::string& input_file, FileAnalysis& result, const std::string* contents) {
+    static const std::unordered_set<std::string> preprocessorDirectives = {
+        ".include", ".macro", ".rept", ".if", ".ifdef", ".ifndef", ".ifeq", ".ifne"};
+    std::ifstream file;
+    MemoryBuffer memory(contents);
+    std::istream infile(&memory);
+    std::string line, token;
+    size_t commentPos;
+    bool globalFlag = false;
+
+    if (std::filesystem::path(input_file).extension() == ".aecir") return false;
+    if (contents == nullptr)
+    {
+        file.open(input_file);
+        if (!file.is_open()) return false;
+        infile.rdbuf(file.rdbuf());
+    }
+    result.inputFile = input_file;
+
+    while (std::getline(infile, line))
+    {
+        commentPos = line.find('@');
+        if (commentPos == std::string::npos) commentPos = line.find('/');
+        std::istringstream iss(line.substr(0, commentPos));
+        bool first = true;
+
+        while (iss >> token)
+        {
+            if (first && token.back() == ':') continue;     // Labels don't change the line
+            if (first && token[0] != '.') break;            // Instruction line
+            first = false;
+
+            if (preprocessorDirectives.find(token) != preprocessorDirectives.end()) return false;
+            if (token == ".global") globalFlag = true;
+            else if (token == ".data")
+            {
+                result.dataExists = true;
+                result.globalErrorFlag = !globalFlag;
+                return true;
+            }
+        }
+    }
+
+    return true;    // No .data at all
+}
+
+/***************************************************************************
+ * precheckReader runs only the catastrophic error check over a file or
+ * every .s file of a folder, on all cores. Files the directives can't
+ * decide are analyzed in full. Rejected files are printed, the return
+ * value is 1 if any file was rejected. */
+int precheckReader(std::string input, const AnalysisOptions& options) {
+    std::vector<std::string> files;
+    std::vector<FileAnalysis> results;
+    int rejected = 0;
+
+    if (std::filesystem::is_directory(input))
+    {
+        for (auto& file : assemblyFiles(input)) files.push_back(file.path.string());
+    }
+    else files.push_back(input);
+    results.resize(files.size());
+
+    parallelFor(files.size(), [&](size_t i)
+    {
+        if (!precheckFile(files[i], results[i]))
+        {
+            results[i] = FileAnalysis();
+            if (!analyzeFile(files[i], results[i], options)) exit(-1);
+        }
+    });
+
+    for (auto& result : results)
+    {
+        std::string fileName = std::filesystem::path(result.inputFile).filename().string();
+        if (result.dataExists == false)
+        {
+            std::cout << fileName << ": Catastrophic error: Missing .data section. Error must be addressed before using AEC" << "\n";
+            rejected++;
+        }
+        else if (result.globalErrorFlag == true)
+        {
+            std::cout << fileName << ": Catastrophic error: .data section comes before .global. Error must be addressed before using AEC" << "\n";
+            rejected++;
+        }
+    }
+    std::cout << files.size() << " files checked, " << rejected << " rejected\n";
+
+    return rejected > 0 ? 1 : 0;
+}
+
+/***************************************************************************
+ * preprocessFile expands .include, .macro, .rept and .if/.ifdef/.ifndef
+ * before the file is analyzed, so the metrics count the code that is
+ * really assembled and included files get checked too. The directive
+ * lines themselves are kept so directive use is still reported. Every
+ * expanded line is recorded in the source map. What can't be expanded,
+ * like an included file that can't be opened, is reported to log and
+ * left as it is. Returns false, with the stream rewound, if the file has
+ * nothing to expand. */
+bool preprocessFile(std::istream& infile, FileAnalysis& result, IncludeCache* includes, std::string& expanded, std::ostream& log) {
+    static const std::unordered_set<std::string> preprocessorDirectives = {
+        ".include", ".macro", ".rept", ".if", ".ifdef", ".ifndef", ".ifeq", ".ifne"};
+    std::vector<std::string> lines;
+    std::string line, token;
+    std::unordered_map<std::string, Macro> macros;
+    std::unordered_map<std::string, long long> symbols;     // .equ and .set values for .if
+    int expansions = 0;     // Counter for \@ in macro bodies
+    bool needed = false, tooLarge = false;
+
+    while (std::getline(infile, line))
+    {
+        std::istringstream iss(line);
+        token.clear();
+        if (iss >> token && token.back() == ':') iss >> token;
+        if (preprocessorDirectives.find(token) != preprocessorDirectives.end()) needed = true;
+        lines.push_back(line);
+    }
+    infile.clear();
+    infile.seekg(0);
+    if (needed == false) return false;
+
+    result.sourceFiles.push_back(std::filesystem::path(result.inputFile).filename().string());
+    std::filesystem::path directory = std::filesystem::path(result.inputFile).parent_path();
+
+    /*******************************************************************************
+     * Numbers and .equ symbols can be compared with == != < > <= >=, anything
+     * unknown counts as 0 like an undefined symbol does for the assembler.
+     * A symbol read here is used, even if no instruction names it. */
+    auto term = [&](std::string text) -> long long
+    {
+        text.erase(std::remove_if(text.begin(), text.end(), [](char c) { return std::isspace(static_cast<unsigned char>(c)) || c == '(' || c == ')' || c == '#'; }), text.end());
+        auto symbol = symbols.find(text);
+        if (symbol != symbols.end())
+        {
+            result.preprocessorUses.insert(text);
+            return symbol->second;
+        }
+        try { return std::stoll(text, nullptr, 0); }
+        catch (...) { return 0; }
+    };
+    auto evaluate = [&](const std::string& text) -> long long
+    {
+        static const char* comparisons[] = {"==", "!=", "<=", ">=", "<", ">"};
+        for (const char* op : comparisons)
+        {
+            size_t pos = text.find(op);
+            if (pos == std::string::npos) continue;
+            long long left = term(text.substr(0, pos)), right = term(text.substr(pos + std::strlen(op)));
+            if (op[0] == '=') return left == right;
+            if (op[0] == '!') return left != right;
+            if (op[1] == '=') return op[0] == '<' ? left <= right : left >= right;
+            return op[0] == '<' ? left < right : left > right;
+        }
+        return term(text);
+    };
+    // Index of the line closing the block opened at start, like .macro and .endm
+    auto closing = [](const std::vector<std::string>& text, size_t start, size_t end,
+        const std::unordered_set<std::string>& openers, const std::string& closer) -> size_t
+    {
+        int depth = 1;
+        std::string token;
+        for (size_t j = start + 1; j < end; j++)
+        {
+            std::istringstream iss(text[j]);
+            token.clear();
+            if (iss >> token && token.back() == ':') iss >> token;
+            if (openers.find(token) != openers.end()) depth++;
+            else if (token == closer && --depth == 0) return j;
+        }
+        return end;
+    };
+    // Splits macro arguments on commas, or on spaces if there are no commas
+    auto splitArguments = [](std::string text) -> std::vector<std::string>
+    {
+        std::vector<std::string> arguments;
+        std::string argument;
+        char separator = text.find(',') != std::string::npos ? ',' : ' ';
+        std::istringstream iss(text);
+        while (std::getline(iss, argument, separator))
+        {
+            argument.erase(0, argument.find_first_not_of(" \t"));
+            argument.erase(argument.find_last_not_of(" \t\r") + 1);
+            if (!argument.empty() || separator == ',') arguments.push_back(argument);
+        }
+        return arguments;
+    };
+
+    /*******************************************************************************
+     * expand copies lines begin to end of text into the expanded file. Lines of
+     * a real file map to themselves, pinned is set while expanding a macro so
+     * all of its lines map to the line that used it. */
+    std::function<void(const std::vector<std::string>&, size_t, size_t, int, int, const SourceLine*, int)> expand;
+    expand = [&](const std::vector<std::string>& text, size_t begin, size_t end, int file, int site,
+        const SourceLine* pinned, int depth)
+    {
+        std::vector<std::pair<bool, bool>> conditions;  // Is the branch read, was a branch of the .if taken
+        std::string first, label, rest;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            if (result.sourceMap.size() >= maxExpandedLines)
+            {
+                if (tooLarge == false) log << result.inputFile << ": Expanded file too large, expansion stopped\n";
+                tooLarge = true;
+                return;
+            }
+            SourceLine here;
+            if (pinned != nullptr) here = *pinned;
+            else
+            {
+                here.file = file;
+                here.line = i + 1;
+                here.site = file == 0 ? i + 1 : site;
+            }
+            auto emit = [&](const std::string& out)
+            {
+                expanded += out;
+                expanded += '\n';
+                result.sourceMap.push_back(here);
+            };
+
+            // Comments can't hold directives, paths in .include can hold a /
+            std::string code = text[i].substr(0, std::min(text[i].find('@'), text[i].find("//")));
+            std::istringstream iss(code);
+            first.clear();
+            label.clear();
+            iss >> first;
+            if (!first.empty() && first.back() == ':')
+            {
+                label = first;
+                first.clear();
+                iss >> first;
+            }
+            std::getline(iss, rest);
+
+            bool reading = conditions.empty() || conditions.back().first;
+            bool parentReading = conditions.size() < 2 || conditions[conditions.size() - 2].first;
+
+            /*******************************************************************************
+             * Conditional assembly, lines in a branch that isn't taken are dropped */
+            if (first == ".if" || first == ".ifdef" || first == ".ifndef" || first == ".ifeq" || first == ".ifne")
+            {
+                bool value = false;
+                if (reading)
+                {
+                    std::istringstream name(rest);
+                    std::string symbol;
+                    name >> symbol;
+                    if (first == ".ifdef" || first == ".ifndef") result.preprocessorUses.insert(symbol);
+                    if (first == ".ifdef") value = symbols.find(symbol) != symbols.end();
+                    else if (first == ".ifndef") value = symbols.find(symbol) == symbols.end();
+                    else if (first == ".ifeq") value = evaluate(rest) == 0;
+                    else value = evaluate(rest) != 0;
+                    emit(text[i]);
+                }
+                conditions.push_back({reading && value, !reading || value});
+                continue;
+            }
+            if ((first == ".elseif" || first == ".else") && !conditions.empty())
+            {
+                auto& condition = conditions.back();
+                condition.first = parentReading && !condition.second && (first == ".else" || evaluate(rest) != 0);
+                condition.second = condition.second || condition.first;
+                if (parentReading) emit(text[i]);
+                continue;
+            }
+            if (first == ".endif" && !conditions.empty())
+            {
+                if (parentReading) emit(text[i]);
+                conditions.pop_back();
+                continue;
+            }
+            if (reading == false) continue;
+
+            if (depth > 64)
+            {
+                log << result.inputFile << ": Macros or includes nested too deeply at line " << here.site << "\n";
+                return;
+            }
+
+            /*******************************************************************************
+             * .macro name params, the body is kept until .endm and only expanded
+             * where the macro is used */
+            if (first == ".macro")
+            {
+                size_t last = closing(text, i, end, {".macro"}, ".endm");
+                std::istringstream definition(rest);
+                std::string name, parameters;
+                definition >> name;
+                if (!name.empty() && name.back() == ',') name.pop_back();
+                std::getline(definition, parameters);
+
+                Macro& macro = macros[name];
+                macro = Macro();
+                for (auto& parameter : splitArguments(parameters))
+                {
+                    if (parameter.empty()) continue;
+                    size_t equals = parameter.find('=');
+                    std::string value = equals == std::string::npos ? "" : parameter.substr(equals + 1);
+                    parameter = parameter.substr(0, std::min(equals, parameter.find(':')));
+                    macro.parameters.push_back(parameter);
+                    macro.defaults.push_back(value);
+                }
+                macro.body.assign(text.begin() + i + 1, text.begin() + std::min(last, end));
+
+                emit(text[i]);
+                i = last;
+                if (last < end)
+                {
+                    if (pinned == nullptr)
+                    {
+                        here.line = last + 1;
+                        if (file == 0) here.site = last + 1;
+                    }
+                    emit(text[last]);
+                }
+                continue;
+            }
+
+            /*******************************************************************************
+             * .rept count, the body is copied count times */
+            if (first == ".rept")
+            {
+                size_t last = closing(text, i, end, {".rept", ".irp"}, ".endr");
+                long long count = evaluate(rest);
+                emit(text[i]);
+                for (long long copy = 0; copy < count && copy < 10000; copy++)
+                {
+                    expand(text, i + 1, last, file, site, pinned, depth + 1);
+                }
+                i = last;
+                if (last < end)
+                {
+                    if (pinned == nullptr)
+                    {
+                        here.line = last + 1;
+                        if (file == 0) here.site = last + 1;
+                    }
+                    emit(text[last]);
+                }
+                continue;
+            }
+
+            /*******************************************************************************
+             * .include "file", looked for next to the file including it first */
+            if (first == ".include")
+            {
+                std::string name = rest;
+                name.erase(0, name.find_first_not_of(" \t\""));
+                name = name.substr(0, name.find('"'));
+                name.erase(name.find_last_not_of(" \t\r") + 1);
+                std::filesystem::path path = file == 0 ? directory / name : std::filesystem::path(result.sourceFiles[file]).parent_path() / name;
+                std::error_code error;
+                if (!std::filesystem::exists(path, error)) path = name;
+
+                // Only regular files, a device or a fifo could be read forever
+                std::shared_ptr<const std::vector<std::string>> included;
+                std::string key = std::filesystem::is_regular_file(path, error) ? std::filesystem::canonical(path, error).string() : "";
+                if (includes != nullptr)
+                {
+                    std::lock_guard<std::mutex> guard(includes->lock);
+                    auto cached = includes->files.find(key);
+                    if (cached != includes->files.end()) included = cached->second;
+                }
+                if (included == nullptr)
+                {
+                    std::ifstream includeFile;
+                    if (!key.empty()) includeFile.open(path);
+                    if (!includeFile.is_open())
+                    {
+                        log << result.inputFile << ": Failed to open included file " << name << " at line " << here.site << "\n";
+                        emit(text[i]);
+                        continue;
+                    }
+                    auto includeLines = std::make_shared<std::vector<std::string>>();
+                    while (std::getline(includeFile, line)) includeLines->push_back(line);
+                    included = includeLines;
+                    if (includes != nullptr)
+                    {
+                        std::lock_guard<std::mutex> guard(includes->lock);
+                        includes->files.emplace(key, included);
+                    }
+                }
+
+                int includeIndex = std::find(result.sourceFiles.begin(), result.sourceFiles.end(), path.string()) - result.sourceFiles.begin();
+                if (includeIndex == (int)result.sourceFiles.size()) result.sourceFiles.push_back(path.string());
+                emit(text[i]);
+                expand(*included, 0, included->size(), includeIndex, here.site, pinned, depth + 1);
+                continue;
+            }
+
+            // .equ and .set values are remembered for .if
+            if ((first == ".equ" || first == ".set") && rest.find(',') != std::string::npos)
+            {
+                std::string name = rest.substr(0, rest.find(','));
+                name.erase(std::remove_if(name.begin(), name.end(), ::isspace), name.end());
+                symbols[name] = evaluate(rest.substr(rest.find(',') + 1));
+            }
+
+            /*******************************************************************************
+             * A macro in the operator position is replaced by its body with the
+             * arguments put in for \parameter */
+            auto found = macros.find(first);
+            if (found != macros.end())
+            {
+                const Macro& macro = found->second;
+                std::vector<std::string> arguments = splitArguments(rest), values = macro.defaults;
+                for (size_t k = 0, position = 0; k < arguments.size(); k++)
+                {
+                    size_t equals = arguments[k].find('=');
+                    auto named = equals == std::string::npos ? macro.parameters.end() :
+                        std::find(macro.parameters.begin(), macro.parameters.end(), arguments[k].substr(0, equals));
+                    if (named != macro.parameters.end()) values[named - macro.parameters.begin()] = arguments[k].substr(equals + 1);
+                    else if (position < values.size()) values[position++] = arguments[k];
+                }
+
+                // Longer names first so \ab isn't replaced as \a followed by b
+                std::vector<size_t> order(macro.parameters.size());
+                for (size_t k = 0; k < order.size(); k++) order[k] = k;
+                std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return macro.parameters[a].size() > macro.parameters[b].size(); });
+
+                std::vector<std::string> body = macro.body;
+                std::string counter = std::to_string(expansions++);
+                for (auto& bodyLine : body)
+                {
+                    for (size_t k : order)
+                    {
+                        std::string name = "\\" + macro.parameters[k];
+                        for (size_t pos = bodyLine.find(name); pos != std::string::npos; pos = bodyLine.find(name, pos + values[k].size()))
+                        {
+                            bodyLine.replace(pos, name.size(), values[k]);
+                        }
+                    }
+                    for (size_t pos = bodyLine.find("\\()"); pos != std::string::npos; pos = bodyLine.find("\\()", pos)) bodyLine.erase(pos, 3);
+                    for (size_t pos = bodyLine.find("\\@"); pos != std::string::npos; pos = bodyLine.find("\\@", pos)) bodyLine.replace(pos, 2, counter);
+                }
+
+                if (!label.empty()) emit(label);
+                expand(body, 0, body.size(), file, here.site, &here, depth + 1);
+                continue;
+            }
+
+            emit(text[i]);
+        }
+    };
+
+    expand(lines, 0, lines.size(), 0, 0, nullptr, 0);
+    return true;
+}
+
+/***************************************************************************
+ * mapSourceLines turns the preprocessed line numbers in the results back
+ * into lines of the files the user wrote. Lines of included files are
+ * reported with the file name. Copies of a line, like the body of a .rept
+ * or a macro used on it, map to the same line, so a message they all
+ * have is only kept once. */
+void mapSourceLines(FileAnalysis& result) {
+    if (result.sourceMap.empty()) return;
+
+    static std::vector<std::string> FileAnalysis::* const messages[] = {
+        &FileAnalysis::stringError, &FileAnalysis::unwantedInstructions, &FileAnalysis::branchUse,
+        &FileAnalysis::svcUse, &FileAnalysis::subroutineUse, &FileAnalysis::isolatedCode,
+        &FileAnalysis::unusedConditional, &FileAnalysis::restrictedError, &FileAnalysis::noReturnError,
+        &FileAnalysis::lrSaveError, &FileAnalysis::branchOutError, &FileAnalysis::registerError,
+        &FileAnalysis::deadStoreError, &FileAnalysis::stackError};
+    auto site = [&](int line) { return line >= 1 && line <= (int)result.sourceMap.size() ? result.sourceMap[line - 1].site : line; };
+
+    for (auto message : messages)
+    {
+        std::unordered_set<std::string> seen;
+        std::vector<std::string> kept;
+        for (auto& text : result.*message)
+        {
+            std::string mapped;
+            size_t pos = 0, found;
+            while ((found = text.find("line ", pos)) != std::string::npos)
+            {
+                size_t digits = found + 5, stop = text.find_first_not_of("0123456789", digits);
+                if (stop == std::string::npos) stop = text.size();
+                mapped += text.substr(pos, digits - pos);
+                pos = stop;
+                if (stop == digits) continue;
+
+                int line = stop - digits > 9 ? 0 : std::stoi(text.substr(digits, stop - digits));
+                if (line < 1 || line > (int)result.sourceMap.size())
+                {
+                    mapped += text.substr(digits, stop - digits);
+                    continue;
+                }
+                const SourceLine& source = result.sourceMap[line - 1];
+                mapped += std::to_string(source.line);
+                if (source.file != 0) mapped += " of " + result.sourceFiles[source.file];
+            }
+            text = mapped + text.substr(pos);
+            if (seen.insert(text).second) kept.push_back(std::move(text));
+        }
+        (result.*message).swap(kept);
+    }
+
+    for (auto& modeLines : result.addressLines)
+    {
+        for (auto& line : modeLines) line = site(line);
+    }
+    for (auto& directive : result.directiveUse)
+    {
+        for (auto& line : directive.second) line = site(line);
+    }
+    for (auto& function : result.functions) function.line = site(function.line);
+    for (auto& lines : result.registerUse)
+    {
+        std::unordered_set<int> mapped;
+        for (int line : lines) mapped.insert(site(line));
+        lines = mapped;
+    }
+}
+
+/***************************************************************************
+ * analyzeLines reads the file line by line and turns each line into tokens.
+ * The tokens are used to fill in everything that can be learned from the
+ * line itself. Checks that need the whole file are left to finishAnalysis.
+ * Isa is the instruction set profile the analyzer is built for. */
+template <class Isa>
+void analyzeLines(std::istream& infile, FileAnalysis& result, const RuleSet& rules, const ChunkStart& start) {
+    std::unordered_set<std::string> compareList = {
+        "EQ", "eq", "NE", "ne", "GE", "ge", "LT", "lt", "GT", "gt", "LE", "le", "CS", "cs", "CC", 
+        "cc", "MI", "mi", "PL", "pl", "VS", "vs", "VC", "vc", "HI", "hi", "LS", "ls", "AL", "al"};
+    std::string line, token, subtoken, linePreComment;
+    int commentPos, cmpLine = 0, numTokens = 0, loadedOperands = 0;
+    bool operatorFlag = false, branchFlag = false, movFlag = false;
+    bool globalFlag = false, dataFlag = false, globalNameFlag = false;
+    bool checkSVC = false, restrictedRegisterFlag = false, pushFlag = false, equFlag = false;
+    bool blBranchFlag = false, noReturnBranch = false, cmpNextLine = false;
+    bool bxBranchFlag = false, popFlag = false, loadMultipleFlag = false;
+    bool movPCFlag = false;
+    bool memoryFlag = false;    // A load or store, its operands are joined into address
+    std::string address;
+    bool functionFlag = result.outputs & (OUTPUT_USAGE | OUTPUT_FUNCTIONS);   // Halstead's of each label as well
+
+    // Unique operands count for the file and for the label they're under.
+    // The label keeps pointers to the file's strings, counted once folded.
+    auto addOperand = [&](const std::string& operand)
+    {
+        auto found = result.uniqueOperands.insert(operand).first;
+        if (functionFlag && !result.functions.empty()) result.functions.back().operands.push_back(&*found);
+    };
+    uint32_t operandMask;
+
+    result.model.registerCount = Isa::registerCount;
+    result.model.alwaysLoaded = Isa::alwaysLoaded;
+    result.model.returnLive = Isa::returnLive;
+    result.model.checked = Isa::checked;
+    result.model.argumentMask = Isa::argumentMask;
+    result.totalLines = start.line;
+    dataFlag = start.dataFlag;
+    globalFlag = start.globalFlag;
+
+    /***************************************************************************
+     * This sections reads and stores the file in a vector of strings
+     * It also collects all the labels and custom variables for later analysis*/
+    while (std::getline(infile, line)) 
+    {
+        // Push the new line into a vector of strings to be able to test it later
+        // Also establish each new lines flags
+        result.totalLines++;
+        operatorFlag = false;
+        restrictedRegisterFlag = false;
+        branchFlag = false;
+        blBranchFlag = false;
+        bxBranchFlag = false;
+        pushFlag = false;
+        movFlag = false;
+        equFlag = false;
+        movPCFlag = false;
+        popFlag = false;
+        loadMultipleFlag = false;
+        memoryFlag = false;
+        address.clear();
+        numTokens = 0;
+        loadedOperands = 0;
+        globalNameFlag = false;
+        std::istringstream iss(line);    // Grab token of line to check first token
+        iss >> token;  
+
+        /**************************************************************************
+         * A line can be empty, a full comment, or have functional code in it
+         * From there it can have a comment or not */
+        if (line.find_first_not_of(' ') == std::string::npos) 
+        {
+            result.blankLines++;
+        } 
+        else if (token[0] == '@' || token[0] == '/')
+        {
+            result.fullCommentLines++;
+        }
+        else
+        {
+            if (line.find("@") != std::string::npos || line.find("/") != std::string::npos) 
+            {
+                result.linesWComment++;
+            } 
+            else 
+            {
+                result.linesWOComment++;
+            }
+
+            /*********************************************************************************
+             * Comments don't need to be tokenized so we make sublines without them.
+             * The example programs have comments with @ and / * so we check for both. */
+            if(line.find('@') != std::string::npos) commentPos = line.find('@'); // End at @
+            else if(line.find('/') != std::string::npos) commentPos = line.find('/'); // End at /
+            else commentPos = line.size();  // If no comment is detected grab full line
+            linePreComment = line.substr(0, commentPos);    // Get rid of comment
+
+            std::istringstream issToken(linePreComment);    // Grab tokens of the uncommented line
+
+            while (issToken >> token)   // While there are still tokens on the line
+            {
+                if (!token.empty()) 
+                {
+                    numTokens++; // Placement checker for tokens
+
+                    /***************************************************************************************
+                     * A token can be identified by its position and by its contents. A token in the first
+                     * position that lacks any other defining elements, like : or . is an operator. This
+                     * kind of logic prevents the need for sets which may not hold all available operators.*/
+                    if (numTokens == 1 && token[0] != '.' && token.back() != ':')
+                    {
+                        result.totalOperators++;               // Halstead's total operators
+                        auto unique = result.uniqueOperators.insert(token).first;  // Halstead's unique operators
+                        if (functionFlag)
+                        {
+                            if (result.functions.empty()) result.functions.push_back({"", start.line + 1});
+                            result.functions.back().totalOperators++;
+                            result.functions.back().operators.push_back(&*unique);
+                        }
+                        operatorFlag = true;    // Establish that the rest of the tokens in this line are operands
+
+                        /*****************************************************************
+                         * Every operator starts a new instruction for the register
+                         * dataflow engine. The operator decides how control leaves
+                         * the instruction and if its first operand is being loaded. */
+                        result.code.push_back(Instruction());
+                        result.code.back().line = result.totalLines;
+                        loadedOperands = Isa::classifyOperator(token, result.code.back());
+
+                        // One lookup tells every check below what the operator is
+                        const uint32_t* known = rules.operators != nullptr ? (*rules.operators)[Isa::profile].find(token) : nullptr;
+                        uint32_t checks = known != nullptr ? *known : operatorChecks<Isa>(token, rules);
+                        memoryFlag = checks & CHECK_LOAD_STORE;
+                        if(result.outputs & OUTPUT_IR) result.code.back().op = token;
+                        if(result.outputs & OUTPUT_SIMILARITY) result.tokenHashes.push_back(hashToken(token, true));
+
+                        /*****************************************************************************************
+                         * cmpNextLine means the previous lines operator was cmp. We then check individually that
+                         * the token, the next operator contains a conditional flag to validate the need for the
+                         *  cmp operator. */
+                        if(cmpNextLine == true)
+                        {
+                            if(token.length() > 2)  // Don't want to grab subtoken of 2 if token isn't large enough
+                            {
+                                subtoken = token.substr(token.length() - 2, 2);   // Grab only the last 2 characters of the token
+                                if(compareList.find(subtoken) == compareList.end()) // Check against list of comparison commands
+                                {
+                                    result.unusedConditional.push_back(findingText(FINDING_UNUSED_CONDITION, "", cmpLine - 1));
+                                }
+
+                            }
+                            else    // If token isn't large enough, it doesn't have a conditional element
+                            {
+                                result.unusedConditional.push_back(findingText(FINDING_UNUSED_CONDITION, "", cmpLine));
+                            }
+
+                            cmpNextLine = false;
+                        }
+                        /*****************************************************************
+                         * noReturnBranch stores an error if there was an operator used
+                         * after a b branch but before a new label*/
+                        if(noReturnBranch == true)
+                        {
+                            result.isolatedCode.push_back(findingText(FINDING_ISOLATED_CODE, "", result.totalLines));
+                        }
+                        /*****************************************************************
+                         * if the first character of an operator is a b then the operator
                          * is a branch. This is a stylistic choice of arm assembly.
                          * Once we determine an operator is a branch we set a flag to
                          * identify the following operands as being part of a branch.*/
-                        else if (token[0] == 'b' || token[0] == 'B') // Check if operator is a branch
+                        else if (checks & CHECK_BRANCH) // Check if operator is a branch
+                        {
+                            result.cyclomatic++;   // Cyclomatic complexitiy is 1 + # of branches
+                            if (functionFlag) result.functions.back().cyclomatic++;
+                            branchFlag = true;
+                            if(checks & CHECK_CALL)
+                            {
+                                blBranchFlag = true;
+                            }
+                            else if(checks & CHECK_REGISTER_BRANCH)
+                            {
+                                bxBranchFlag = true;
+                            }
+                            else if(checks & CHECK_BARE_RETURN)
+                            {   // ret returns through the link register without an operand
+                                result.returnLineNum.push_back(result.totalLines);
+                                result.subroutineUse.push_back(findingText(FINDING_RETURN, token, result.totalLines));
+                            }
+                            else if(checks & CHECK_UNCONDITIONAL)
+                            {   // Once a b branch is done, any code until next label is isolated
+                                noReturnBranch = true;
+                            }
+                        }
+                        /*****************************************************************
+                         * Unwantedoperators are a list of operators we don't expect the
+                         * student to use. A rules file can give its own list. */
+                        else if((result.enabledRules >> RULE_UNWANTED_INSTRUCTION & 1) && (checks & CHECK_UNWANTED))
+                        {
+                            result.unwantedInstructions.push_back(findingText(FINDING_UNWANTED, "", result.totalLines));
+                        }
+                        /************************************************************************
+                         * If a value is being loaded then the following operands could
+                         * include the registers that are not for standard use: r13, r14, r15 */
+                        else if(checks & CHECK_LOAD)
+                        {
+                            restrictedRegisterFlag = true; // Check all operands on this line
+                        }
+                        /****************************************************************
+                         * Same as LDR                        */
+                        else if(checks & CHECK_MOVE)
+                        {
+                            restrictedRegisterFlag = true; // Check all operands on this line
+                            movFlag = true;
+                        }
+                        /*****************************************************************
+                         * If operator is svc then we check that the following operand 
+                         * is 0 to validate an exit from the program. */
+                        else if((checks & CHECK_SVC) && dataFlag != true)
+                        {
+                            checkSVC = true;
+                        }
+                        /*****************************************************************
+                         * Check the next line for use of the comparison flag update */
+                        else if(checks & CHECK_COMPARE)
+                        {
+                            cmpNextLine = true;
+                            cmpLine = result.totalLines;
+                        }
+                        /****************************************************************
+                         * Check if the LR is saved via Push, whatever else the operator
+                         * was reported as, like an unwanted ldm */
+                        if(Isa::isPush(token, linePreComment))
+                        {
+                            pushFlag = true;
+                        }
+                        else if(Isa::isPop(token, linePreComment))
+                        {
+                            popFlag = true;
+                            result.code.back().restore = true;  // Popped values are restores, never dead stores
+                        }
+                        else if(checks & CHECK_LOAD_MULTIPLE)
+                        {
+                            loadMultipleFlag = true;
+                        }
+                    }
+                    /*****************************************************************
+                     * A token following an operator is an operand. It can be a
+                     * register, a defined value, or a literal. */
+                    else if (operatorFlag == true) 
+                    {
+                        result.totalOperands++;
+                        if (memoryFlag) address += token;
+                        if (functionFlag) result.functions.back().totalOperands++;
+                        if(result.outputs & OUTPUT_IR)
+                        {
+                            result.code.back().operands.push_back(token.back() == ',' ? token.substr(0, token.size() - 1) : token);
+                        }
+                        if(result.outputs & OUTPUT_SIMILARITY) result.tokenHashes.push_back(hashToken(token, false));
+                        /******************************************************************************
+                         * Validating uniqueness of operands by removing , [ ] and []
+                         * Then each operand is stored in an unordered set to ignore multiple entries*/
+                        if(token.find(",") != std::string::npos && token.find("[") == std::string::npos
+                            && token.find("{") == std::string::npos)
+                        {   // First is if operand has only , like r1,
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(subtoken.size() - 1); // Remove comma
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("[") != std::string::npos && token.find("]") == std::string::npos
+                        && token.find(",") != std::string::npos)
+                        {   // Second is [r1,
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(subtoken.size() - 1); // Remove ,
+                            subtoken.erase(0, 1); // Remove [
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("[") != std::string::npos && token.find("]") != std::string::npos &&
+                        token.find("!") == std::string::npos && token.find(",") == std::string::npos)
+                        {   // Third is [r1]
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(subtoken.size() - 1); // Remove ]
+                            subtoken.erase(0, 1); // Remove [
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("[") != std::string::npos && token.find("]") != std::string::npos &&
+                        token.find("!") == std::string::npos && token.find(",") != std::string::npos)
+                        {   // Fourth is [r1],
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(subtoken.size() - 2); // Remove ],
+                            subtoken.erase(0, 1); // Remove [
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("[") == std::string::npos && token.find("]") != std::string::npos &&
+                        token.find("!") == std::string::npos && token.find("#") == std::string::npos)
+                        {   // Fifth is r1]
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(subtoken.size() - 1); // Remove ]
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("[") != std::string::npos && token.find("]") != std::string::npos &&
+                        token.find("!") != std::string::npos)
+                        {   // Sixth is [r1]!
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(subtoken.size() - 2); // Remove ]!
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("{") != std::string::npos && token.find("}") != std::string::npos)
+                        {   // Seventh is {}
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(subtoken.size() - 1); // Remove }
+                            subtoken.erase(0, 1); // Remove {
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("{") != std::string::npos && token.find("}") == std::string::npos
+                            && token.find(",") != std::string::npos)
+                        {   // Eigth is {r1,
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(0, 1); // Remove {
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("{") == std::string::npos && token.find("}") != std::string::npos
+                            && token.find(",") == std::string::npos)
+                        {   // Ninth is r1}
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(subtoken.size() - 1); // Remove }
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("=") != std::string::npos)
+                        {   // Tenth is =variable
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(0, 1); // Remove =
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("#") != std::string::npos && token.find("]") == std::string::npos)
+                        {   // Eleventh is literal #
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(0, 1); // Remove #
+                            addOperand(subtoken);
+                        }
+                        else if(token.find("#") != std::string::npos && token.find("]") != std::string::npos)
+                        {   // Twelth is literal #]
+                            subtoken = token;   // Don't ever edit token directly
+                            subtoken.erase(0, 1); // Remove #
+                            subtoken.erase(subtoken.size() - 1); // remove ]
+                            addOperand(subtoken);
+                        }
+                        else
+                        {   // Last is freestanding, r1  for example
+                            addOperand(token);
+                            subtoken = token;
+                        }
+
+                        /*****************************************************************
+                         * Registers named by the operand are recorded as loaded or read
+                         * for the dataflow engine. A POP loads every register it names,
+                         * an ldm every register of its list after the base register,
+                         * otherwise only the first operand of a loading operator is. */
+                        operandMask = Isa::registerMask(token);
+                        if(popFlag == true || numTokens - 1 <= loadedOperands || (loadMultipleFlag == true && numTokens > 2))
+                        {
+                            result.code.back().defMask |= operandMask;
+                        }
+                        else if(pushFlag == true)   // Saving a register that was never loaded is fine
+                        {
+                            result.code.back().argumentMask |= operandMask;
+                        }
+                        else
+                        {
+                            result.code.back().useMask |= operandMask;
+                        }
+                        if(pushFlag == true)
                         {
-                            cyclomatic++;   // Cyclomatic complexitiy is 1 + # of branches
-                            branchFlag = true;
-                            if(token == "bl" || token == "BL")
+                            result.code.back().stackDelta += int(std::bitset<32>(operandMask & ~Isa::stackPointerMask).count());
+                        }
+                        else if(popFlag == true)
+                        {
+                            result.code.back().stackDelta -= int(std::bitset<32>(operandMask & ~Isa::stackPointerMask).count());
+                        }
+                        if((result.code.back().defMask & Isa::pcMask) && result.code.back().flow != FLOW_RETURN)
+                        {   // Loading the PC is a return, like pop {r4, pc} or ldmfd sp!, {r4, pc}
+                            result.code.back().flow = FLOW_RETURN;
+                            result.returnLineNum.push_back(result.totalLines);
+                        }
+                        if(numTokens == 2 || result.code.back().flow == FLOW_COND_BRANCH)
+                        {   // The label is the last operand, like cbz r0, label
+                            result.code.back().target = token;
+                            if(result.code.back().call == true)
                             {
-                                blBranchFlag = true;
+                                if(token == "scanf" || token == "printf")
+                                {   // Wipe registers on scanf and printf
+                                    result.code.back().clobberMask = Isa::argumentMask;
+                                }
+                                else
+                                {   // Subroutines hand back their result in r0
+                                    result.code.back().defMask |= 0x00000001;
+                                }
                             }
-                            else if(token == "bx" || token == "BX")
+                        }
+
+                        /*****************************************************************
+                         * The operands following a branch operator. We collect the
+                         * branch, where it occurs, and how many branches there are.
+                         * We also identify bl and non bl branch use at line.*/
+                        if(branchFlag == true)
+                        {
+                            if(token != "scanf" && token != "printf" && token.back() != ',' &&
+                            (numTokens == 2 || result.code.back().flow == FLOW_COND_BRANCH))
                             {
-                                bxBranchFlag = true;
+                                if (blBranchFlag == true)
+                                {
+                                    result.subroutineUse.push_back(findingText(FINDING_CALL, token, result.totalLines));
+                                    result.subroutines.insert(token);
+                                    result.blCallLineNum.push_back(result.totalLines);
+                                }
+                                else if(bxBranchFlag == true)
+                                {
+                                    if(Isa::isLinkRegister(token))
+                                    {
+                                        result.returnLineNum.push_back(result.totalLines);
+                                    }
+                                    result.subroutineUse.push_back(findingText(FINDING_RETURN_BRANCH, token, result.totalLines));
+                                }
+                                else
+                                {
+                                    result.branchUse.push_back(findingText(FINDING_BRANCH, token, result.totalLines));
+                                    // badbranches are used to check if subroutines branch outside their bounds
+                                    result.badBranchLineNum.push_back(result.totalLines);
+                                    result.badBranchTarget.push_back(token);
+                                }
                             }
-                            else if(token == "b" || token == "B")
-                            {   // Once a b branch is done, any code until next label is isolated
-                                noReturnBranch = true;
+                        } 
+                        /*****************************************************************
+                         * If the operator is svc then we check the following operand
+                         * for correct exit. We also store svc use at occuring lines */
+                        else if(checkSVC == true)
+                        {
+                            if(token == "0" || token == "#0")
+                            {
+                                result.exitExists = true;
                             }
+                            result.svcUse.push_back(findingText(FINDING_SVC, token, result.totalLines));
+                            checkSVC = false;
                         }
-                        /*****************************************************************
-                         * Unwantedoperators are a list of operators we don't expect the
-                         * student to use. */
-                        else if(unwantedOperators.find(token) != unwantedOperators.end())
+                        /**********************************************************************
+                         * We check the token against a set to determine if it is a
+                         * register. It is then identified by line and place in instruction.*/
+                        else if((result.outputs & OUTPUT_USAGE) && Isa::registerNumber(subtoken) >= 0)
                         {
-                            unwantedInstructions.push_back("Unexpected instruction at line " + std::to_string(totalLines));
+                            result.registerUse[Isa::registerNumber(subtoken)].insert(result.totalLines);
                         }
-                        /************************************************************************
-                         * If a value is being loaded then the following operands could
-                         * include the registers that are not for standard use: r13, r14, r15 */
-                        else if(token.find("ldr") != std::string::npos || token.find("LDR") != std::string::npos) 
+                        /***************************************************************
+                         * If the operator was PUSH we want to check if the LR is saved
+                         * for future checks            */
+                        if(pushFlag == true && Isa::savesLinkRegister(token))
                         {
-                            restrictedRegisterFlag = true; // Check all operands on this line
-                            ldrFlag = true;
+                            result.lrSaveLineNum.push_back(result.totalLines);
                         }
-                        /****************************************************************
-                         * Same as LDR                        */
-                        else if(token.find("mov") != std::string::npos || token.find("MOV") != std::string::npos)
+                        /***************************************************************
+                         * If movflag is true, then we check to see if LR was saved or
+                         * check for mov pc, lr for a way to return 
+                         * needs to be seperate if statement to not conflict 
+                         * with checking for restricted registers*/ 
+                        if(movFlag == true)
+                        {   
+                            if(movPCFlag == true)
+                            {
+                                if (Isa::isLinkRegister(token))
+                                {
+                                    result.returnLineNum.push_back(result.totalLines);
+                                }
+                            }
+                            if(Isa::isLinkRegister(token) && numTokens == 3)
+                            { // mov r, lr is a save format
+                                result.lrSaveLineNum.push_back(result.totalLines);
+                            }
+                            else if (token == "pc," || token == "PC,")
+                            {
+                                movPCFlag = true; // check for mov pc, lr
+                            }
+                            /*****************************************************************
+                             * If ldr or mov was used then we need to validate that the 
+                             * registers r13, r14, and r15 were not used. We validate against
+                             * a set.*/
+                            if(restrictedRegisterFlag == true && (result.enabledRules >> RULE_RESTRICTED_REGISTER & 1))
+                            {
+                                if(rules.customRestricted ? rules.restricted.find(subtoken) != rules.restricted.end() :
+                                    Isa::isRestricted(subtoken))
+                                {
+                                    result.restrictedError.push_back(findingText(FINDING_RESTRICTED, subtoken, result.totalLines));
+                                }
+                            }
+                        }
+                    }
+                    /********************************************************************
+                     * A token is a directive if it begins with a . and is followed
+                     * by a letter. Directives provide instructions to how the code
+                     * should be handled.*/
+                    else if (token[0] == '.' && std::isalpha(static_cast<unsigned char>(token[1])))
+                    {
+                        result.dirLines++;
+                        result.directiveUse[token].push_back(result.totalLines);
+                        //directiveUse.push_back(token + " directive used at line " + std::to_string(totalLines));
+
+                        /*****************************************************************
+                         * .global is checked for to see if it comes before .data*/
+                        if (token == ".global") 
                         {
-                            restrictedRegisterFlag = true; // Check all operands on this line
-                            movFlag = true;
+                            globalFlag = true; // We have seen global directive
+                            globalNameFlag = true;
+                            dataFlag = false;
                         }
-                        /************************************************************
-                         * Checks the next operands for addressing modes  */
-                        else if(token.find("str") != std::string::npos || token.find("STR") != std::string::npos)
+                        /*****************************************************************
+                         * .data is checked first to see if it comes before .global
+                         * and also to determine user defined variables*/
+                        else if (token == ".data")
                         {
-                            strFlag = true;
+                            dataFlag = true; // Inside the .data section
+                            result.dataExists = true; // .data is inside file
+                            result.dataLineNum = result.totalLines;
+                            if (globalFlag == false)    // If .data comes before .global
+                            {
+                                result.globalErrorFlag = true;
+                            }
                         }
                         /*****************************************************************
-                         * If operator is svc then we check that the following operand 
-                         * is 0 to validate an exit from the program. */
-                        else if((token.find("svc") != std::string::npos || token.find("SVC") != std::string::npos) && dataFlag != true)
+                         * .equ will be checked so that the following tokens will be 
+                         * handled to validate the use of constants*/
+                        else if (token == ".equ")
                         {
-                            checkSVC = true;
+                            equFlag = true;
                         }
                         /*****************************************************************
-                         * Check the next line for use of the comparison flag update */
-                        else if(token == "cmp" || token == "CMP")
+                         * If we are in .data section and the token is .global, handled 
+                         * above, or .text, then we are out of the .data section.
+                         * These are the two most common exits and anything more 
+                         * complicated than that will be very visually wrong. */
+                        if(token == ".text")
                         {
-                            cmpNextLine = true;
-                            cmpLine = totalLines;
+                            dataFlag = false; // Out of .data section
                         }
-                        /****************************************************************
-                         * Check if the LR is saved via Push                        */
-                        else if(token.find("push") != std::string::npos || token.find("PUSH") != std::string::npos)
+                    }
+                    /********************************************************************
+                     * If we are in the .data section, and the token ends with a :
+                     * then the token is defining a user defined variable */
+                    else if(token.back() == ':' && dataFlag == true && numTokens == 1)
+                    {
+                        subtoken = token;   // Never edit the token
+                        subtoken.erase(subtoken.size() - 1);    // Cut off the :
+                        result.variables.push_back(subtoken);
+                        result.variableLineNum.push_back(result.totalLines);
+                    }
+                    /********************************************************************
+                     * If the token is not in the .data section and ends in a :
+                     * then it is a label defining a section of the program */
+                    else if(token.back() == ':' && dataFlag == false && numTokens == 1)
+                    {
+                        numTokens--;
+                        // In streaming mode the labels before this one are checked and let go
+                        if(result.streamBudget != 0 && result.code.size() >= result.streamBudget)
                         {
-                            pushFlag = true;
+                            streamWindow(result, result.totalLines);
                         }
-                        else if(token.find("pop") != std::string::npos || token.find("POP") != std::string::npos)
+                        subtoken = token; // Never edit the token
+                        subtoken.erase(subtoken.size() - 1);    // Cut off the :
+                        result.labels.push_back(subtoken);
+                        result.labelLineNum.push_back(result.totalLines); // The line the label starts at
+                        result.labelIndex[subtoken] = result.code.size(); // The next instruction starts the label
+                        if (functionFlag) result.functions.push_back({subtoken, result.totalLines});
+                        noReturnBranch = false; // Once a label is found code can be reached again
+                    }
+                    /********************************************************************
+                     * The token after .global is a symbol other files can use */
+                    else if(globalNameFlag == true && numTokens == 2)
+                    {
+                        result.globals.push_back(token);
+                    }
+                    /********************************************************************
+                     * If we are in the .equ section
+                     * then the second token in the line is a constant */
+                    else if(equFlag == true && numTokens == 2)
+                    {
+                        subtoken = token; // Never edit the token
+                        subtoken.erase(subtoken.size() - 1); // Cut of the ,
+                        result.constants.push_back(subtoken);
+                        result.constantLineNum.push_back(result.totalLines);
+                    }
+
+                    // The sp! of stmfd and ldmfd is where they push and pop, not what
+                    bool stackBase = Isa::registerMask(token) == Isa::stackPointerMask && token.find_first_of("{[") == std::string::npos;
+                    if(pushFlag == true && numTokens != 1 && !stackBase)
+                    {
+                        result.pushNum++;
+                    }
+                    else if(popFlag == true && numTokens != 1 && !stackBase)
+                    {
+                        result.popNum++;
+                    }
+                }
+            }
+        }
+
+        /*******************************************************************
+         *              START LINE BASED CHECKS HERE        */
+
+        /*******************************************************************
+         * The addressing mode of a load or store is decoded from all of its
+         * operands once the line is tokenized, and kept with the instruction. */
+        if(memoryFlag == true)
+        {
+            AddressMode mode = decodeAddress<Isa>(address);
+            result.code.back().mode = mode;
+            if(result.outputs & OUTPUT_USAGE) result.addressLines[mode].push_back(result.totalLines);
+        }
+        
+        /********************************************************************
+         * If the token is within the .data section. We validate the line has
+         * a quote to define a string, then check if it ends in \ n 
+         * We seperate this section from others because it works with the
+         * whole line.*/
+        if(dataFlag == true && (result.enabledRules >> RULE_STRING_NEWLINE & 1))
+        {  
+            // Ignore common .data elements that would flag like numInputPattern:
+            bool exception = false;
+            for(auto& label : rules.stringExceptions)
+            {
+                if(line.find(label) != std::string::npos) exception = true;
+            }
+            if(exception == false)
+            {   // Check that the line has a quote but doesn't end a quote with \n"
+                if(line.find('"') != std::string::npos && line.find("\\n\"") == std::string::npos) 
+                {
+                    result.stringError.push_back(findingText(FINDING_STRING_NEWLINE, "", result.totalLines));
+                }
+            }
+        }
+    }
+}
+
+/***************************************************************************
+ * operatorChecks works out the OperatorChecks of an operator, for the
+ * operator tables and for spellings they don't have. */
+template <class Isa>
+uint32_t operatorChecks(const std::string& token, const RuleSet& rules) {
+    uint32_t checks = 0;
+
+    if (Isa::isBranch(token)) checks |= CHECK_BRANCH;
+    if (Isa::isCall(token)) checks |= CHECK_CALL;
+    if (Isa::isRegisterBranch(token)) checks |= CHECK_REGISTER_BRANCH;
+    if (Isa::isBareReturn(token)) checks |= CHECK_BARE_RETURN;
+    if (Isa::isUnconditionalBranch(token)) checks |= CHECK_UNCONDITIONAL;
+    if (rules.customUnwanted ? rules.unwanted.find(token) != rules.unwanted.end() : Isa::isUnwanted(token)) checks |= CHECK_UNWANTED;
+    if (token.find("ldr") != std::string::npos || token.find("LDR") != std::string::npos) checks |= CHECK_LOAD;
+    if (token.find("mov") != std::string::npos || token.find("MOV") != std::string::npos) checks |= CHECK_MOVE;
+    if (token.find("svc") != std::string::npos || token.find("SVC") != std::string::npos) checks |= CHECK_SVC;
+    if (token == "cmp" || token == "CMP") checks |= CHECK_COMPARE;
+    if (isLoadStore(token)) checks |= CHECK_LOAD_STORE;
+    if (Isa::isLoadMultiple(token)) checks |= CHECK_LOAD_MULTIPLE;
+    return checks;
+}
+
+/***************************************************************************
+ * isLoadStore is true for the operators that take an address: ldr, str,
+ * their byte, half and exclusive forms, and AArch64's ldp, stp, ldur and
+ * stur. ldm and stm take a register list instead. */
+bool isLoadStore(const std::string& token) {
+    if (token.size() < 3) return false;
+    std::string op = token.substr(0, 4);
+    std::transform(op.begin(), op.end(), op.begin(), ::tolower);
+    return op.compare(0, 3, "ldr") == 0 || op.compare(0, 3, "str") == 0 || op.compare(0, 3, "ldp") == 0 ||
+        op.compare(0, 3, "stp") == 0 || op == "ldur" || op == "stur";
+}
+
+/***************************************************************************
+ * decodeAddress finds the addressing mode from the operands of a load or
+ * store, joined without spaces like r0,[r1,#4]! The address is the bracket,
+ * whatever registers come before it, so ldrd and ldp decode like ldr.
+ * Without a bracket the last operand is a literal or a label. */
+template <class Isa>
+AddressMode decodeAddress(const std::string& operands) {
+    size_t open = operands.find('[');
+
+    if (open == std::string::npos)
+    {
+        size_t last = operands.rfind(',');
+        if (last == std::string::npos || last + 1 == operands.size()) return MODE_UNSURE;
+        std::string target = operands.substr(last + 1);
+        if (target[0] == '=') return MODE_PC_LITERAL;
+        if (target[0] == '#' || target[0] == '{' || Isa::registerMask(target) != 0) return MODE_UNSURE;
+        return MODE_PC_RELATIVE;    // A label is read relative to the PC
+    }
+
+    size_t close = operands.find(']', open);
+    if (close == std::string::npos) return MODE_UNSURE;
+    size_t comma = operands.find(',', open);
+    std::string base = operands.substr(open + 1, std::min(comma, close) - open - 1);
+    std::transform(base.begin(), base.end(), base.begin(), ::tolower);
+
+    if (close + 1 == operands.size())
+    {
+        if (base == "pc") return MODE_PC_RELATIVE;
+        return comma < close ? MODE_INDIRECT_OFFSET : MODE_INDIRECT;
+    }
+    if (close + 2 == operands.size() && operands[close + 1] == '!') return MODE_PRE_INDEX;
+    if (operands[close + 1] == ',' && close + 2 < operands.size()) return MODE_POST_INDEX;
+    return MODE_UNSURE;
+}
+
+/***************************************************************************
+ * finishAnalysis runs the checks that need the whole file, like unused
+ * labels, the label analyzer and the register and stack dataflow. When the
+ * file is part of a project the linked symbols of every file are used so
+ * labels and subroutines shared between files are not reported. */
+void finishAnalysis(FileAnalysis& result, const ProjectSymbols* project) {
+    /*******************************************************************************
+     * In a project the global labels other files call with bl are subroutines
+     * too, so they get the same checks as the ones called from this file. */
+    if(project != nullptr)
+    {
+        for(auto& name : result.globals)
+        {
+            if(project->called.find(name) != project->called.end()) result.subroutines.insert(name);
+        }
+    }
+
+    checkWindow(result, project, result.dataLineNum);
+
+    /*******************************************************************************
+     * A value that is defined would be used as an operand somewhere in the program.
+     * If the value is not in the list of unique operands then it was not used. */
+    for(auto labels : {&result.streamedLabels, &result.labels})
+    {
+        for(size_t i = 0; (result.enabledRules >> RULE_UNUSED_LABEL & 1) && i < labels->size(); i++)
+        {
+            const std::string& label = (*labels)[i];
+            if(result.uniqueOperands.find(label) == result.uniqueOperands.end() &&
+            (project == nullptr || project->referenced.find(label) == project->referenced.end() ||
+            std::find(result.globals.begin(), result.globals.end(), label) == result.globals.end()))
+            {
+                result.unusedLabel.push_back("Unused label: " + label);
+            }
+        }
+    }
+    for(size_t i = 0; (result.enabledRules >> RULE_UNUSED_VARIABLE & 1) && i < result.variables.size(); i++)
+    {
+        if(result.uniqueOperands.find(result.variables[i]) == result.uniqueOperands.end())
+        {
+            result.unusedVariable.push_back("Unused user variable: " + result.variables[i]);
+        }
+    }
+    for(size_t i = 0; (result.enabledRules >> RULE_UNUSED_CONSTANT & 1) && i < result.constants.size(); i++)
+    {
+        if(result.uniqueOperands.find(result.constants[i]) == result.uniqueOperands.end() &&
+        result.preprocessorUses.find(result.constants[i]) == result.preprocessorUses.end())
+        {
+            result.unusedConstant.push_back("Unused user constant: " + result.constants[i]);
+        }
+    }
+
+    dropDisabledRules(result);
+    mapSourceLines(result);
+    if(result.outputs & OUTPUT_SIMILARITY) winnowTokens(result);
+
+    // Halstead's
+    result.length = result.totalOperators + result.totalOperands; 
+    result.vocabulary = result.uniqueOperators.size() + result.uniqueOperands.size();
+    result.volume = result.length * log2(result.vocabulary);
+    result.difficulty = (double(result.uniqueOperators.size()) / 2.0) * (double(result.totalOperands) / double(result.uniqueOperands.size())); 
+    result.effort = result.difficulty * result.volume;
+    foldFunctions(result);
+}
+
+/***************************************************************************
+ * foldFunctions folds every label into the subroutine it is part of, the
+ * last label before it that starts one: a bl target, a .global label, or
+ * the first label of the file. Then Halstead's is worked out for each. */
+void foldFunctions(FileAnalysis& result) {
+    std::vector<FunctionMetrics> folded;
+
+    for (auto& function : result.functions)
+    {
+        bool starts = folded.empty() || result.subroutines.find(function.name) != result.subroutines.end() ||
+            std::find(result.globals.begin(), result.globals.end(), function.name) != result.globals.end();
+        if (starts) folded.push_back(std::move(function));
+        else folded.back().merge(function);
+    }
+    for (auto& function : folded)
+    {
+        for (auto uses : {&function.operators, &function.operands})
+        {
+            std::sort(uses->begin(), uses->end());
+            uses->erase(std::unique(uses->begin(), uses->end()), uses->end());
+        }
+        function.uniqueOperatorCount = function.operators.size();
+        function.uniqueOperandCount = function.operands.size();
+        function.operators = std::vector<const std::string*>();
+        function.operands = std::vector<const std::string*>();
+        function.length = function.totalOperators + function.totalOperands;
+        function.vocabulary = function.uniqueOperatorCount + function.uniqueOperandCount;
+        function.volume = function.vocabulary > 0 ? function.length * log2(function.vocabulary) : 0;
+        function.difficulty = function.uniqueOperandCount == 0 ? 0 :
+            (double(function.uniqueOperatorCount) / 2.0) * (double(function.totalOperands) / double(function.uniqueOperandCount));
+        function.effort = function.difficulty * function.volume;
+    }
+    result.functions = std::move(folded);
+}
+
+/***************************************************************************
+ * checkWindow runs the checks that need the instructions and labels read
+ * so far: the register and stack dataflow and the label analyzer. The
+ * last label ends at endLine. finishAnalysis checks the whole file at
+ * once, streaming mode checks one window of labels at a time. */
+void checkWindow(FileAnalysis& result, const ProjectSymbols* project, int endLine) {
+    std::vector<BasicBlock> blocks;
+    std::vector<size_t> blockOf;
+    int nextLabel;
+    bool subroutineFlag = false, returnFlag = false;
+    bool subroutineCall = false, lrSaved = false;
+
+    // Registers and the stack are checked along every path the program can take
+    bool registerChecks = (result.enabledRules >> RULE_REGISTER_BEFORE_LOAD & 1) || (result.enabledRules >> RULE_DEAD_STORE & 1);
+    bool callChecks = (result.outputs & OUTPUT_USAGE) || (result.enabledRules >> RULE_STACK_BALANCE & 1);
+    bool labelChecks = (result.enabledRules >> RULE_NO_RETURN & 1) || (result.enabledRules >> RULE_LR_SAVE & 1) ||
+        (result.enabledRules >> RULE_BRANCH_OUT & 1);
+    if(registerChecks || callChecks)
+    {
+        blocks = buildBlocks(result.code, result.labelIndex, result.subroutines, result.model, blockOf);
+    }
+    if(registerChecks)
+    {
+        registerDataflow(result.code, blocks, result.model, result.registerError, result.deadStoreError);
+    }
+    if(callChecks)
+    {
+        callGraph(result.code, blocks, blockOf, result.labelIndex, result.labels, result.subroutines, project, nullptr,
+            result.callGraphUse, result.stackError);
+    }
+
+    /*****************************************************************************
+     * Label analyzer, it first defines what kind of label is being checked first
+     * then reads in line numbers of various flags to determine what happens 
+     * within said label to determine errors. It works because label and
+     * labelLineNum are correlated positionally. */
+    for(size_t i = 0; labelChecks && i < result.labels.size(); i++)
+    {
+        subroutineFlag = false;
+        returnFlag = false;
+        subroutineCall = false;
+        lrSaved = false;
+
+        // Declare whether the current label is a subroutine
+        if(result.subroutines.find(result.labels[i]) != result.subroutines.end()) subroutineFlag = true;
+
+        if(subroutineFlag == true)  
+        {
+            // The last label will have nothing to compare to, so we use .data instead
+            if(i + 1 != result.labels.size())
+            {
+                nextLabel = result.labelLineNum[i+1];
+            }
+            else if(i + 1 == result.labels.size())
+            {
+                nextLabel = endLine;
+            }
+            // If the label is a subroutine, check that it has a return before the label ends
+            for (size_t j = 0; j < result.returnLineNum.size(); j++)
+            {
+                // If any of the returns happen between when the label starts and ends
+                if(result.returnLineNum[j] >= result.labelLineNum[i] && result.returnLineNum[j] < nextLabel)
+                {
+                    returnFlag = true;
+                }
+            }
+            // Check if a call to a subroutine is made inside the subroutine
+            for (size_t j = 0; j < result.blCallLineNum.size(); j++)
+            {   // If any of the subroutine calls happen between label start and end
+                if(result.blCallLineNum[j] >= result.labelLineNum[i] && result.blCallLineNum[j] < nextLabel)
+                {
+                    subroutineCall = true;
+                    for(size_t k = 0; k < result.lrSaveLineNum.size(); k++)
+                    {   // If the LR was saved in a label where a subroutine was called after the label line
+                        // number but before the subroutine call line number
+                        if(result.lrSaveLineNum[k] >= result.labelLineNum[i] && result.lrSaveLineNum[k] <= result.blCallLineNum[j])
                         {
-                            popFlag = true;
+                            lrSaved = true;
                         }
                     }
-                    /*****************************************************************
-                     * A token following an operator is an operand. It can be a
-                     * register, a defined value, or a literal. */
-                    else if (operatorFlag == true) 
-                    {
-                        totalOperands++;
-                        /******************************************************************************
-                         * Validating uniqueness of operands by removing , [ ] and []
-                         * Then each operand is stored in an unordered set to ignore multiple entries*/
-                        if(token.find(",") != std::string::npos && token.find("[") == std::string::npos
-                            && token.find("{") == std::string::npos)
-                        {   // First is if operand has only , like r1,
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(subtoken.size() - 1); // Remove comma
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("[") != std::string::npos && token.find("]") == std::string::npos
-                        && token.find(",") != std::string::npos)
-                        {   // Second is [r1,
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(subtoken.size() - 1); // Remove ,
-                            subtoken.erase(0, 1); // Remove [
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("[") != std::string::npos && token.find("]") != std::string::npos &&
-                        token.find("!") == std::string::npos && token.find(",") == std::string::npos)
-                        {   // Third is [r1]
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(subtoken.size() - 1); // Remove ]
-                            subtoken.erase(0, 1); // Remove [
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("[") != std::string::npos && token.find("]") != std::string::npos &&
-                        token.find("!") == std::string::npos && token.find(",") != std::string::npos)
-                        {   // Fourth is [r1],
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(subtoken.size() - 2); // Remove ],
-                            subtoken.erase(0, 1); // Remove [
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("[") == std::string::npos && token.find("]") != std::string::npos &&
-                        token.find("!") == std::string::npos && token.find("#") == std::string::npos)
-                        {   // Fifth is r1]
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(subtoken.size() - 1); // Remove ]
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("[") != std::string::npos && token.find("]") != std::string::npos &&
-                        token.find("!") != std::string::npos)
-                        {   // Sixth is [r1]!
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(subtoken.size() - 2); // Remove ]!
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("{") != std::string::npos && token.find("}") != std::string::npos)
-                        {   // Seventh is {}
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(subtoken.size() - 1); // Remove }
-                            subtoken.erase(0, 1); // Remove {
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("{") != std::string::npos && token.find("}") == std::string::npos
-                            && token.find(",") != std::string::npos)
-                        {   // Eigth is {r1,
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(0, 1); // Remove {
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("{") == std::string::npos && token.find("}") != std::string::npos
-                            && token.find(",") == std::string::npos)
-                        {   // Ninth is r1}
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(subtoken.size() - 1); // Remove }
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("=") != std::string::npos)
-                        {   // Tenth is =variable
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(0, 1); // Remove =
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("#") != std::string::npos && token.find("]") == std::string::npos)
-                        {   // Eleventh is literal #
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(0, 1); // Remove #
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else if(token.find("#") != std::string::npos && token.find("]") != std::string::npos)
-                        {   // Twelth is literal #]
-                            subtoken = token;   // Don't ever edit token directly
-                            subtoken.erase(0, 1); // Remove #
-                            subtoken.erase(subtoken.size() - 1); // remove ]
-                            uniqueOperands.insert(subtoken);
-                        }
-                        else
-                        {   // Last is freestanding, r1  for example
-                            uniqueOperands.insert(token);
-                            subtoken = token;
-                        }
+                }
+            }
+            // Check if  subroutine branches outside of its bounds
+            for (size_t j = 0; j < result.badBranchLineNum.size(); j++)
+            {
+                // If any of the returns happen between when the label starts and ends
+                if(result.badBranchLineNum[j] >= result.labelLineNum[i] && result.badBranchLineNum[j] < nextLabel)
+                {
+                    // A branch to a global label of another file is a tail call, not a branch out
+                    if(project != nullptr && project->globalFile.find(result.badBranchTarget[j]) != project->globalFile.end() &&
+                    result.labelIndex.find(result.badBranchTarget[j]) == result.labelIndex.end()) continue;
+
+                    result.branchOutError.push_back(result.labels[i] + " branches out of the subroutine bounds at line " + 
+                    std::to_string(result.badBranchLineNum[j]));
+                }
+            }
+        }
+        // If there is a subroutine but not a return
+        if(subroutineFlag == true && returnFlag == false)
+        {
+            result.noReturnError.push_back(result.labels[i] + " has no return despite being a subroutine.");
+        }
+        // If there is a subroutine but not a saved spot
+        if(subroutineCall == true && lrSaved == false)
+        {
+            result.lrSaveError.push_back(result.labels[i] + " has a call to a subroutine in it without saving the LR first.");
+        }
+    }
+
+}
+
+/***************************************************************************
+ * streamWindow checks the labels read so far in streaming mode, prints
+ * their errors to the file's streamOut and lets go of everything kept for them. Only the label
+ * names and lines are kept, for the unused label check at the end of the file.
+ * Branches into a window already let go are treated like branches out of
+ * the file. */
+void streamWindow(FileAnalysis& result, int endLine) {
+    static std::vector<std::string> FileAnalysis::* const windowLists[] = {
+        &FileAnalysis::labels, &FileAnalysis::badBranchTarget, &FileAnalysis::stringError,
+        &FileAnalysis::unwantedInstructions, &FileAnalysis::branchUse, &FileAnalysis::svcUse,
+        &FileAnalysis::subroutineUse, &FileAnalysis::isolatedCode, &FileAnalysis::unusedConditional,
+        &FileAnalysis::restrictedError, &FileAnalysis::noReturnError, &FileAnalysis::lrSaveError,
+        &FileAnalysis::branchOutError, &FileAnalysis::registerError, &FileAnalysis::deadStoreError,
+        &FileAnalysis::stackError, &FileAnalysis::callGraphUse};
+    static std::vector<int> FileAnalysis::* const windowLines[] = {
+        &FileAnalysis::labelLineNum, &FileAnalysis::returnLineNum, &FileAnalysis::blCallLineNum,
+        &FileAnalysis::lrSaveLineNum, &FileAnalysis::badBranchLineNum};
+
+    checkWindow(result, nullptr, endLine);
+    dropDisabledRules(result);
+    writeErrors(result, *result.streamOut, false);
+
+    result.streamedLabels.insert(result.streamedLabels.end(), result.labels.begin(), result.labels.end());
+    result.streamedLabelLineNum.insert(result.streamedLabelLineNum.end(), result.labelLineNum.begin(), result.labelLineNum.end());
+    for (auto list : windowLists) (result.*list).clear();
+    for (auto list : windowLines) (result.*list).clear();
+    result.code.clear();
+    result.labelIndex.clear();
+    result.directiveUse.clear();
+}
+
+/***************************************************************************
+ * Checks turned off by the rules file are dropped here, so every output
+ * format leaves them out. No exit and push/pop counts are flags that
+ * writeResults checks itself. */
+void dropDisabledRules(FileAnalysis& result) {
+    for(int rule = 0; rule < RULE_COUNT; rule++)
+    {
+        if(ruleOutput[rule] != nullptr && !(result.enabledRules >> rule & 1)) (result.*ruleOutput[rule]).clear();
+    }
+}
+
+/***************************************************************************
+ * forEachError calls found with every error of a file and the rule that
+ * found it, the no exit and push/pop flags first, then by rule. */
+void forEachError(const FileAnalysis& result, const std::function<void(int, const std::string&)>& found) {
+    if (result.exitExists == false && (result.enabledRules >> RULE_NO_EXIT & 1))
+    {
+        found(RULE_NO_EXIT, "No proper exit, svc 0, from program before .data section");
+    }
+    if ((result.enabledRules >> RULE_PUSH_POP_COUNT & 1) && result.pushNum != result.popNum)
+    {
+        found(RULE_PUSH_POP_COUNT, result.pushNum > result.popNum ?
+            "More pushes detected than pops. Ensure that all values are popped off the heap." :
+            "More pops detected than pushes. Ensure that there is always a value on the heap before a Pop.");
+    }
+    for (int rule = 0; rule < RULE_COUNT; rule++)
+    {
+        if (ruleOutput[rule] == nullptr) continue;
+        for (auto& message : result.*ruleOutput[rule]) found(rule, message);
+    }
+}
+
+/***************************************************************************
+ * errorLine is the line an error names with "line N", 0 if it names none
+ * or names a line of an included file. */
+int errorLine(const std::string& message) {
+    size_t found = message.find("line ");
+    if (found == std::string::npos || !std::isdigit(static_cast<unsigned char>(message[found + 5]))) return 0;
+    size_t stop = message.find_first_not_of("0123456789", found + 5);
+    if (stop != std::string::npos && message.compare(stop, 4, " of ") == 0) return 0;
+    if ((stop == std::string::npos ? message.size() : stop) - found - 5 > 9) return 0;
+    return std::stoi(message.substr(found + 5));
+}
+
+/***************************************************************************
+ * Adds one analyzed file to the corpus totals. Files rejected for a
+ * catastrophic error are only counted. */
+void CorpusStatistics::add(const FileAnalysis& result) {
+    files++;
+    if (result.dataExists == false || result.globalErrorFlag == true)
+    {
+        rejected++;
+        return;
+    }
+
+    volume.add(result.volume);
+    effort.add(result.effort);
+    difficulty.add(result.difficulty);
+    cyclomatic.add(result.cyclomatic);
+    lines.add(result.totalLines);
+
+    for (int rule = 0; rule < RULE_COUNT; rule++)
+    {
+        size_t found = 0;
+        if (!(result.enabledRules >> rule & 1)) continue;
+        if (ruleOutput[rule] != nullptr) found = (result.*ruleOutput[rule]).size();
+        else if (rule == RULE_NO_EXIT) found = !result.exitExists;
+        else if (rule == RULE_PUSH_POP_COUNT) found = result.pushNum != result.popNum;
+        errors[rule] += found;
+        if (found > 0) filesWithError[rule]++;
+    }
+
+    for (auto& op : result.uniqueOperators)
+    {
+        operators[op]++;
+    }
+}
+
+void CorpusStatistics::merge(const CorpusStatistics& other) {
+    files += other.files;
+    rejected += other.rejected;
+    volume.merge(other.volume);
+    effort.merge(other.effort);
+    difficulty.merge(other.difficulty);
+    cyclomatic.merge(other.cyclomatic);
+    lines.merge(other.lines);
+    for (int rule = 0; rule < RULE_COUNT; rule++)
+    {
+        errors[rule] += other.errors[rule];
+        filesWithError[rule] += other.filesWithError[rule];
+    }
+    for (auto& op : other.operators)
+    {
+        operators[op.first] += op.second;
+    }
+}
+
+/***************************************************************************
+ * writeStatistics writes the corpus totals of --stats: the spread of each
+ * metric over the files, the errors found by each rule and how many files
+ * use each operator. */
+void writeStatistics(const CorpusStatistics& stats, const std::string& output_file) {
+    std::ofstream outfile(output_file);
+    const std::pair<const char*, const QuantileSketch*> metrics[] = {
+        {"Program Volume", &stats.volume}, {"Program Effort", &stats.effort},
+        {"Program Difficulty", &stats.difficulty}, {"Cyclomatic Complexity", &stats.cyclomatic},
+        {"Total number of lines", &stats.lines}};
+
+    outfile << "********************************************************\nCorpus:\n";
+    outfile << "\tFiles read: " << stats.files << "\n";
+    outfile << "\tFiles rejected: " << stats.rejected << "\n";
+    outfile << "********************************************************\n";
+    outfile << "Metrics (count, min, mean, p50, p90, p99, max):\n";
+    for (auto& metric : metrics)
+    {
+        const QuantileSketch& sketch = *metric.second;
+        outfile << "\t" << metric.first << ": " << sketch.count << ", " << sketch.min << ", "
+                << (sketch.count ? sketch.sum / sketch.count : 0) << ", " << sketch.quantile(0.5) << ", "
+                << sketch.quantile(0.9) << ", " << sketch.quantile(0.99) << ", " << sketch.max << "\n";
+    }
+    outfile << "********************************************************\n";
+    outfile << "Errors (total, files):\n";
+    for (int rule = 0; rule < RULE_COUNT; rule++)
+    {
+        outfile << "\t" << ruleNames[rule] << ": " << stats.errors[rule] << ", " << stats.filesWithError[rule] << "\n";
+    }
+    outfile << "********************************************************\n";
+    outfile << "Operators (files using each):\n";
+    std::vector<std::pair<std::string, uint64_t>> operators(stats.operators.begin(), stats.operators.end());
+    std::sort(operators.begin(), operators.end(), [](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b)
+    {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    for (auto& op : operators)
+    {
+        outfile << "\t" << op.first << ": " << op.second << "\n";
+    }
+    outfile << "********************************************************\n";
+}
+
+/***************************************************************************
+ * hashToken hashes a token the way the similarity check compares them.
+ * Operators only lose their case. Operands keep their brackets but not
+ * their names, so renamed registers, labels and values still match. */
+uint64_t hashToken(const std::string& token, bool isOperator) {
+    std::string shape;
+    if (isOperator)
+    {
+        for (char c : token) shape += std::tolower(static_cast<unsigned char>(c));
+    }
+    else
+    {
+        size_t start = token.find_first_not_of("[{"), end = token.find_last_not_of(",]}!");
+        std::string name = start == std::string::npos || end < start ? "" : token.substr(start, end - start + 1);
+        char kind = 'l';    // Label or symbol
+        if (!name.empty() && (name[0] == '#' || name[0] == '=' || std::isdigit(static_cast<unsigned char>(name[0])))) kind = '#';
+        else if (name.size() >= 2 && std::strchr("rxwRXW", name[0]) && std::isdigit(static_cast<unsigned char>(name[1]))) kind = 'r';
+        else if (name == "sp" || name == "lr" || name == "pc" || name == "fp" || name == "ip" ||
+            name == "SP" || name == "LR" || name == "PC" || name == "FP" || name == "IP") kind = 'r';
+        shape = token.substr(0, start == std::string::npos ? token.size() : start) + kind +
+            (end == std::string::npos ? "" : token.substr(end + 1));
+    }
+
+    uint64_t hash = 14695981039346656037ull;    // FNV-1a
+    for (char c : shape)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/***************************************************************************
+ * winnowTokens turns the normalized tokens of a file into its fingerprints.
+ * Every run of k tokens is hashed, and the smallest hash of every window
+ * of w runs is kept, so any copied run of w + k - 1 tokens or more leaves
+ * at least one fingerprint in both files. */
+void winnowTokens(FileAnalysis& result) {
+    const size_t k = 12, w = 8;
+    const std::vector<uint64_t>& tokens = result.tokenHashes;
+    std::vector<uint64_t> grams;
+    size_t chosen = SIZE_MAX;
+
+    for (size_t i = 0; i + k <= tokens.size(); i++)
+    {
+        uint64_t hash = 0;
+        for (size_t j = i; j < i + k; j++) hash = (hash ^ tokens[j]) * 1099511628211ull + (hash >> 29);
+        grams.push_back(hash);
+    }
+    for (size_t i = 0; i + w <= grams.size() || (i == 0 && !grams.empty()); i++)
+    {
+        size_t least = i;
+        for (size_t j = i; j < std::min(i + w, grams.size()); j++)
+        {
+            if (grams[j] <= grams[least]) least = j;  // Rightmost of equal hashes
+        }
+        if (least != chosen) result.fingerprints.push_back(grams[least]);
+        chosen = least;
+    }
+
+    std::sort(result.fingerprints.begin(), result.fingerprints.end());
+    result.fingerprints.erase(std::unique(result.fingerprints.begin(), result.fingerprints.end()), result.fingerprints.end());
+    result.tokenHashes = std::vector<uint64_t>();
+}
+
+/***************************************************************************
+ * writeSimilarity writes the pairs of files of --similar. Only files that
+ * share a fingerprint are counted as a pair. Fingerprints found in more
+ * than 1% of the files, and at least 16, are code every file was given,
+ * like a template, so they are left out. No fingerprint is counted in
+ * more than 64 files either, so each file a fingerprint is found in adds
+ * at most 63 pairs however large the corpus is. A pair is reported when
+ * the shared fingerprints are at least percent of the smaller file's. */
+void writeSimilarity(SimilarityIndex& index, const std::vector<std::string>& paths,
+    const std::vector<uint32_t>& counts, int percent, const std::string& output_file) {
+    size_t common = std::min<size_t>(64, std::max<size_t>(16, paths.size() / 100));
+    std::unordered_map<uint64_t, uint32_t> shared;   // Fingerprints shared by each pair, smaller file first
+    std::vector<std::pair<double, uint64_t>> pairs;
+    std::ofstream outfile(output_file);
+
+    for (auto& print : index.files)
+    {
+        std::vector<uint32_t>& list = print.second;
+        if (list.size() < 2 || list.size() > common) continue;
+        std::sort(list.begin(), list.end());
+        for (size_t a = 0; a < list.size(); a++)
+        {
+            for (size_t b = a + 1; b < list.size(); b++)
+            {
+                shared[uint64_t(list[a]) << 32 | list[b]]++;
+            }
+        }
+    }
+
+    for (auto& pair : shared)
+    {
+        uint32_t smaller = std::min(counts[pair.first >> 32], counts[pair.first & 0xffffffff]);
+        double score = 100.0 * pair.second / std::max<uint32_t>(1, smaller);
+        if (score >= percent) pairs.push_back({score, pair.first});
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const std::pair<double, uint64_t>& a, const std::pair<double, uint64_t>& b)
+    {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    outfile << "********************************************************\nSimilar Files:\n";
+    outfile << "\tFiles read: " << paths.size() << "\n";
+    outfile << "\tPairs at " << percent << "% or more: " << pairs.size() << "\n";
+    outfile << "********************************************************\n";
+    for (auto& pair : pairs)
+    {
+        outfile << "\t" << paths[pair.second >> 32] << ", " << paths[pair.second & 0xffffffff] << ": "
+                << shared[pair.second] << " shared fingerprints, " << int(pair.first) << "%\n";
+    }
+    outfile << "********************************************************\n";
+}
+
+/***************************************************************************
+ * The SARIF document is one run whose rules are AEC's rules, with the
+ * catastrophic errors as one more rule after them. */
+void DiagnosticWriter::begin() {
+    if (format == FORMAT_SARIF)
+    {
+        out << "{\"version\":\"2.1.0\",\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"runs\":[{\"tool\":"
+            "{\"driver\":{\"name\":\"AEC\",\"version\":\"1.0\",\"rules\":[";
+        for (int rule = 0; rule < RULE_COUNT; rule++) out << "{\"id\":\"" << ruleNames[rule] << "\"},";
+        out << "{\"id\":\"catastrophic\"}]}},\"results\":[\n";
+    }
+    else
+    {
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites name=\"AEC\">\n";
+    }
+}
+
+/***************************************************************************
+ * Each error is a SARIF result. In JUnit each file is a test suite and
+ * each rule that was checked is a test case that fails with its errors. */
+void DiagnosticWriter::file(const FileAnalysis& result) {
+    bool catastrophic = !result.failure.empty() || result.dataExists == false || result.globalErrorFlag == true;
+    std::string reason = !result.failure.empty() ? "Analysis failed, " + result.failure :
+        result.dataExists == false ? "Catastrophic error: Missing .data section" :
+        "Catastrophic error: .data section comes before .global";
+    std::string path = uriEscape(result.inputFile);
+
+    if (format == FORMAT_SARIF)
+    {
+        std::unordered_map<std::string, int> definitions;      // Found once an error needs them
+        bool defined = false;
+        auto write = [&](int rule, const std::string& message, const char* level)
+        {
+            int line = errorLine(message);
+            // Unused labels and values are found where they are defined, like the language server does
+            if (line == 0 && rule < RULE_COUNT && message.find("line ") == std::string::npos)
+            {
+                if (!defined)
+                {
+                    definitions = definitionLines(result);
+                    defined = true;
+                }
+                line = definitionLine(message, definitions);
+            }
+            out << (results++ ? ",\n" : "") << "{\"ruleId\":\"" << (rule < RULE_COUNT ? ruleNames[rule] : "catastrophic") <<
+                "\",\"ruleIndex\":" << rule << ",\"level\":\"" << level << "\",\"message\":{\"text\":\"" << jsonEscape(message) <<
+                "\"},\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":\"" << path << "\"}";
+            if (line > 0) out << ",\"region\":{\"startLine\":" << line << "}";
+            out << "}}]}";
+        };
+        if (catastrophic) write(RULE_COUNT, reason, "error");
+        else forEachError(result, [&](int rule, const std::string& message) { write(rule, message, "warning"); });
+        out.flush();
+        return;
+    }
+
+    std::string name = xmlEscape(result.inputFile);
+    if (catastrophic)
+    {
+        out << "  <testsuite name=\"" << name << "\" tests=\"1\" failures=\"0\" errors=\"1\">\n" <<
+            "    <testcase classname=\"" << name << "\" name=\"catastrophic\"><error message=\"" << xmlEscape(reason) <<
+            "\"/></testcase>\n  </testsuite>\n";
+        out.flush();
+        return;
+    }
+
+    std::vector<std::string> failures(RULE_COUNT);
+    int tests = 0, failed = 0;
+    forEachError(result, [&](int rule, const std::string& message) { failures[rule] += xmlEscape(message) + "\n"; });
+    for (int rule = 0; rule < RULE_COUNT; rule++)
+    {
+        tests += result.enabledRules >> rule & 1;
+        failed += !failures[rule].empty();
+    }
+    out << "  <testsuite name=\"" << name << "\" tests=\"" << tests << "\" failures=\"" << failed << "\" errors=\"0\">\n";
+    for (int rule = 0; rule < RULE_COUNT; rule++)
+    {
+        if (!(result.enabledRules >> rule & 1)) continue;
+        out << "    <testcase classname=\"" << name << "\" name=\"" << ruleNames[rule] << "\"";
+        if (failures[rule].empty()) out << "/>\n";
+        else out << "><failure type=\"" << ruleNames[rule] << "\">" << failures[rule] << "</failure></testcase>\n";
+    }
+    out << "  </testsuite>\n";
+    out.flush();
+}
+
+void DiagnosticWriter::end() {
+    if (format == FORMAT_SARIF) out << "\n]}]}\n";
+    else out << "</testsuites>\n";
+    out.flush();
+}
+
+/***************************************************************************
+ * uriEscape percent-encodes a path as a relative URI reference, every
+ * byte but the unreserved ones and the / between folders. A : is encoded
+ * too, so the first folder is never read as a scheme. */
+std::string uriEscape(const std::string& path) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string escaped;
+    for (char c : path)
+    {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (std::isalnum(byte) || c == '-' || c == '.' || c == '_' || c == '~' || c == '/') escaped += c;
+        else escaped += {'%', digits[byte >> 4], digits[byte & 15]};
+    }
+    return escaped;
+}
 
-                        /*****************************************************************
-                         * The operands following a branch operator. We collect the
-                         * branch, where it occurs, and how many branches there are.
-                         * We also identify bl and non bl branch use at line.*/
-                        if(branchFlag == true)
-                        {
-                            if(token != "scanf" && token != "printf" && numTokens == 2)
-                            {
-                                if (blBranchFlag == true)
-                                {
-                                    subroutineUse.push_back("BL " + token + " at line " + std::to_string(totalLines));
-                                    subroutines.insert(token);
-                                    blCallLineNum.push_back(totalLines);
-                                }
-                                else if(bxBranchFlag == true)
-                                {
-                                    if(token == "lr" || token == "LR")
-                                    {
-                                        returnLineNum.push_back(totalLines);
-                                    }
-                                    subroutineUse.push_back("Return branch " + token + " at line " + std::to_string(totalLines));
-                                }
-                                else
-                                {
-                                    branchUse.push_back("Branch " + token + " at line " + std::to_string(totalLines));
-                                    // badbranches are used to check if subroutines branch outside their bounds
-                                    badBranchLineNum.push_back(totalLines);
-                                }
-                            }
-                            else if(token == "scanf" || token == "printf") 
-                            {   // Wipe registers on scanf and printf
-                                r0Flag = false;
-                                r1Flag = false;
-                                r2Flag = false;
-                                r3Flag = false;
-                            }
-                        } 
-                        /*****************************************************************
-                         * If the operator is svc then we check the following operand
-                         * for correct exit. We also store svc use at occuring lines */
-                        else if(checkSVC == true)
-                        {
-                            if(token == "0" || token == "#0")
-                            {
-                                exitExists = true;
-                            }
-                            svcUse.push_back("SVC " + token + " used at line " + std::to_string(totalLines));
-                            checkSVC = false;
-                        }
-                        /**********************************************************************
-                         * We check the token against a set to determine if it is a
-                         * register. It is then identified by line and place in instruction.*/
-                        else if(registers.find(subtoken) != registers.end())
-                        {
-                            switch(subtoken[1])
-                            {
-                                case '0': register0Use.insert(totalLines); break;
-                                case '1':   if(subtoken.size() == 2) register1Use.insert(totalLines); 
-                                            else if(subtoken[2] == '0') register10Use.insert(totalLines);
-                                            else if(subtoken[2] == '1') register11Use.insert(totalLines);
-                                            else if(subtoken[2] == '2') register12Use.insert(totalLines);
-                                            else if(subtoken[2] == '3') register13Use.insert(totalLines);
-                                            else if(subtoken[2] == '4') register14Use.insert(totalLines);
-                                            else if(subtoken[2] == '5') register15Use.insert(totalLines);
-                                            break;
-                                case '2': register2Use.insert(totalLines); break;
-                                case '3': register3Use.insert(totalLines); break;
-                                case '4': register4Use.insert(totalLines); break;
-                                case '5': register5Use.insert(totalLines); break;
-                                case '6': register6Use.insert(totalLines); break;
-                                case '7': register7Use.insert(totalLines); break;
-                                case '8': register8Use.insert(totalLines); break;
-                                case '9': register9Use.insert(totalLines); break;
-                            }
+/***************************************************************************
+ * xmlEscape escapes text for XML content and attributes. */
+std::string xmlEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '&') escaped += "&amp;";
+        else if (c == '<') escaped += "&lt;";
+        else if (c == '>') escaped += "&gt;";
+        else if (c == '"') escaped += "&quot;";
+        else if (static_cast<unsigned char>(c) < 0x20 && c != '\n' && c != '\t') escaped += ' ';
+        else escaped += c;
+    }
+    return escaped;
+}
 
-                            // If the token is a register and the first operand then it is being loaded with a value
-                            // ignore use of CMP since that doesn't load into the first operand
-                            if(numTokens == 2 && cmpNextLine == false && strFlag == false)
-                            {
-                                // Set a flag saying the register has been loaded if it is the second token, aka first operand
-                                switch(subtoken[1])
-                                {
-                                    case '0': r0Flag = true; break;
-                                    case '1':   if(subtoken.size() == 2) r1Flag = true; 
-                                                else if(subtoken[2] == '0') r10Flag = true;
-                                                else if(subtoken[2] == '1') r11Flag = true;
-                                                else if(subtoken[2] == '2') r12Flag = true;
-                                                break;
-                                    case '2': r2Flag = true; break;
-                                    case '3': r3Flag = true; break;
-                                    case '4': r4Flag = true; break;
-                                    case '5': r5Flag = true; break;
-                                    case '6': r6Flag = true; break;
-                                    case '7': r7Flag = true; break;
-                                    case '8': r8Flag = true; break;
-                                    case '9': r9Flag = true; break;
-                                }
-                            }   // If the operator was a POP then everything that comes after it is loaded with a value
-                            else if(popFlag == true)
-                            {
-                                switch(subtoken[1])
-                                {
-                                    case '0': r0Flag = true; break;
-                                    case '1':   if(subtoken.size() == 2) r1Flag = true; 
-                                                else if(subtoken[2] == '0') r10Flag = true;
-                                                else if(subtoken[2] == '1') r11Flag = true;
-                                                else if(subtoken[2] == '2') r12Flag = true;
-                                                break;
-                                    case '2': r2Flag = true; break;
-                                    case '3': r3Flag = true; break;
-                                    case '4': r4Flag = true; break;
-                                    case '5': r5Flag = true; break;
-                                    case '6': r6Flag = true; break;
-                                    case '7': r7Flag = true; break;
-                                    case '8': r8Flag = true; break;
-                                    case '9': r9Flag = true; break;
-                                }
-                            }
-                            else if(strFlag == true && numTokens == 2)
-                            {
-                                // The format is to check if the register has been used, then see if it has been loaded
-                                // and to toss an error if it hasn't
-                                // Error flags are to prevent duplicate errors being thrown for repeated register use
-                                // on the same line
-                                switch(subtoken[1])
-                                {
-                                    case '0':   if(r0Flag == false && r0ErrorFlag == false)
-                                                {
-                                                    r0ErrorFlag = true;
-                                                    registerError.push_back("Register 0 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '1':   if(subtoken.size() == 2)
-                                                {
-                                                    if(r1Flag == false && r1ErrorFlag == false)
-                                                    {
-                                                        r1ErrorFlag = true;
-                                                        registerError.push_back("Register 1 used before being loaded at line " 
-                                                        + std::to_string(totalLines));
-                                                    }
-                                                } 
-                                                else if(subtoken[2] == '0')
-                                                {
-                                                    if(r10Flag == false && r10ErrorFlag == false)
-                                                    {
-                                                        r10ErrorFlag = true;
-                                                        registerError.push_back("Register 10 used before being loaded at line " 
-                                                        + std::to_string(totalLines));
-                                                    }
-                                                } 
-                                                else if(subtoken[2] == '1')
-                                                {
-                                                    if(r11Flag == false && r11ErrorFlag == false)
-                                                    {
-                                                        r11ErrorFlag = true;
-                                                        registerError.push_back("Register 11 used before being loaded at line " 
-                                                        + std::to_string(totalLines));
-                                                    }
-                                                } 
-                                                else if(subtoken[2] == '2')
-                                                {
-                                                    if(r12Flag == false && r12ErrorFlag == false)
-                                                    {
-                                                        r12ErrorFlag = true;
-                                                        registerError.push_back("Register 12 used before being loaded at line " 
-                                                        + std::to_string(totalLines));
-                                                    }
-                                                } 
-                                                break;
-                                    case '2':   if(r2Flag == false && r2ErrorFlag == false)
-                                                {
-                                                    r2ErrorFlag = true;
-                                                    registerError.push_back("Register 2 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '3':   if(r3Flag == false && r3ErrorFlag == false)
-                                                {
-                                                    r3ErrorFlag = true;
-                                                    registerError.push_back("Register 3 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '4':   if(r4Flag == false && r4ErrorFlag == false)
-                                                {
-                                                    r4ErrorFlag = true;
-                                                    registerError.push_back("Register 4 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '5':   if(r5Flag == false && r5ErrorFlag == false)
-                                                {
-                                                    r5ErrorFlag = true;
-                                                    registerError.push_back("Register 5 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '6':   if(r6Flag == false && r6ErrorFlag == false)
-                                                {
-                                                    r6ErrorFlag = true;
-                                                    registerError.push_back("Register 6 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '7':   if(r7Flag == false && r7ErrorFlag == false)
-                                                {
-                                                    r7ErrorFlag = true;
-                                                    registerError.push_back("Register 7 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '8':   if(r8Flag == false && r8ErrorFlag == false)
-                                                {
-                                                    r8ErrorFlag = true;
-                                                    registerError.push_back("Register 8 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '9':   if(r9Flag == false && r9ErrorFlag == false)
-                                                {
-                                                    r9ErrorFlag = true;
-                                                    registerError.push_back("Register 9 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                }
-                            }
-                            else if(numTokens > 2)   // The token is any other operand then the first, and is a register
-                            {
-                                // The format is to check if the register has been used, then see if it has been loaded
-                                // and to toss an error if it hasn't
-                                switch(subtoken[1])
-                                {
-                                    case '0':   if(r0Flag == false && r0ErrorFlag == false)
-                                                {
-                                                    r0ErrorFlag = true;
-                                                    registerError.push_back("Register 0 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '1':   if(subtoken.size() == 2)
-                                                {
-                                                    if(r1Flag == false && r1ErrorFlag == false)
-                                                    {
-                                                        r1ErrorFlag = true;
-                                                        registerError.push_back("Register 1 used before being loaded at line " 
-                                                        + std::to_string(totalLines));
-                                                    }
-                                                } 
-                                                else if(subtoken[2] == '0')
-                                                {
-                                                    if(r10Flag == false && r10ErrorFlag == false)
-                                                    {
-                                                        r10ErrorFlag = true;
-                                                        registerError.push_back("Register 10 used before being loaded at line " 
-                                                        + std::to_string(totalLines));
-                                                    }
-                                                } 
-                                                else if(subtoken[2] == '1')
-                                                {
-                                                    if(r11Flag == false && r11ErrorFlag == false)
-                                                    {
-                                                        r11ErrorFlag = true;
-                                                        registerError.push_back("Register 11 used before being loaded at line " 
-                                                        + std::to_string(totalLines));
-                                                    }
-                                                } 
-                                                else if(subtoken[2] == '2')
-                                                {
-                                                    if(r12Flag == false && r12ErrorFlag == false)
-                                                    {
-                                                        r12ErrorFlag = true;
-                                                        registerError.push_back("Register 12 used before being loaded at line " 
-                                                        + std::to_string(totalLines));
-                                                    }
-                                                } 
-                                                break;
-                                    case '2':   if(r2Flag == false && r2ErrorFlag == false)
-                                                {
-                                                    r2ErrorFlag = true;
-                                                    registerError.push_back("Register 2 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '3':   if(r3Flag == false && r3ErrorFlag == false)
-                                                {
-                                                    r3ErrorFlag = true;
-                                                    registerError.push_back("Register 3 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '4':   if(r4Flag == false && r4ErrorFlag == false)
-                                                {
-                                                    r4ErrorFlag = true;
-                                                    registerError.push_back("Register 4 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '5':   if(r5Flag == false && r5ErrorFlag == false)
-                                                {
-                                                    r5ErrorFlag = true;
-                                                    registerError.push_back("Register 5 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '6':   if(r6Flag == false && r6ErrorFlag == false)
-                                                {
-                                                    r6ErrorFlag = true;
-                                                    registerError.push_back("Register 6 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '7':   if(r7Flag == false && r7ErrorFlag == false)
-                                                {
-                                                    r7ErrorFlag = true;
-                                                    registerError.push_back("Register 7 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '8':   if(r8Flag == false && r8ErrorFlag == false)
-                                                {
-                                                    r8ErrorFlag = true;
-                                                    registerError.push_back("Register 8 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                    case '9':   if(r9Flag == false && r9ErrorFlag == false)
-                                                {
-                                                    r9ErrorFlag = true;
-                                                    registerError.push_back("Register 9 used before being loaded at line "
-                                                    + std::to_string(totalLines));
-                                                } 
-                                                break;
-                                }
-                            }
-                        }
-                        /***************************************************************
-                         * If the operator was PUSH we want to check if the LR is saved
-                         * for future checks            */
-                        else if(pushFlag == true)
-                        {
-                            if(token == "{lr}" || token == "{LR}")
-                            {
-                                lrSaveLineNum.push_back(totalLines);
-                            }
-                        }
-                        /***************************************************************
-                         * If movflag is true, then we check to see if LR was saved or
-                         * check for mov pc, lr for a way to return 
-                         * needs to be seperate if statement to not conflict 
-                         * with checking for restricted registers*/ 
-                        if(movFlag == true)
-                        {   
-                            if(movPCFlag == true)
-                            {
-                                if (token == "lr" || token == "LR")
-                                {
-                                    returnLineNum.push_back(totalLines);
-                                }
-                            }
-                            if((token == "lr" || token == "LR") && numTokens == 3)
-                            { // mov r, lr is a save format
-                                lrSaveLineNum.push_back(totalLines);
-                            }
-                            else if (token == "pc," || token == "PC,")
-                            {
-                                movPCFlag = true; // check for mov pc, lr
-                            }
-                            /*****************************************************************
-                             * If ldr or mov was used then we need to validate that the 
-                             * registers r13, r14, and r15 were not used. We validate against
-                             * a set.*/
-                            if(restrictedRegisterFlag == true)
-                            {
-                                if(restrictedRegisters.find(subtoken) != restrictedRegisters.end())
-                                {
-                                    restrictedError.push_back("Improper use of restricted register "
-                                    + subtoken + " at line " + std::to_string(totalLines));
-                                }
-                            }
-                        }
-                    }
-                    /********************************************************************
-                     * A token is a directive if it begins with a . and is followed
-                     * by a letter. Directives provide instructions to how the code
-                     * should be handled.*/
-                    else if (token[0] == '.' && std::isalpha(token[1]))
-                    {
-                        dirLines++;
-                        directiveUse[token].push_back(totalLines);
-                        //directiveUse.push_back(token + " directive used at line " + std::to_string(totalLines));
+/***************************************************************************
+ * writeResults reports the data of an analyzed file determined by the
+ * variable "command" */
+void writeResults(const FileAnalysis& result, const std::string& output_file, int command) {
+    std::vector<int> sorter;
+    FileTimes times;
 
-                        /*****************************************************************
-                         * .global is checked for to see if it comes before .data*/
-                        if (token == ".global") 
-                        {
-                            globalFlag = true; // We have seen global directive
-                            dataFlag = false;
-                        }
-                        /*****************************************************************
-                         * .data is checked first to see if it comes before .global
-                         * and also to determine user defined variables*/
-                        else if (token == ".data")
-                        {
-                            dataFlag = true; // Inside the .data section
-                            dataExists = true; // .data is inside file
-                            dataLineNum = totalLines;
-                            if (globalFlag == false)    // If .data comes before .global
-                            {
-                                globalErrorFlag = true;
-                            }
-                        }
-                        /*****************************************************************
-                         * .equ will be checked so that the following tokens will be 
-                         * handled to validate the use of constants*/
-                        else if (token == ".equ")
-                        {
-                            equFlag = true;
-                        }
-                        /*****************************************************************
-                         * If we are in .data section and the token is .global, handled 
-                         * above, or .text, then we are out of the .data section.
-                         * These are the two most common exits and anything more 
-                         * complicated than that will be very visually wrong. */
-                        if(token == ".text")
-                        {
-                            dataFlag = false; // Out of .data section
-                        }
-                    }
-                    /********************************************************************
-                     * If we are in the .data section, and the token ends with a :
-                     * then the token is defining a user defined variable */
-                    else if(token.back() == ':' && dataFlag == true && numTokens == 1)
+    namespace fs = std::filesystem;
+    fs::path filePath(result.inputFile);
+    std::string fileName = filePath.filename().string();
+
+    // A file a worker process couldn't analyze has nothing to report
+    if (!result.failure.empty())
+    {
+        std::cout << fileName << ": Analysis failed, " << result.failure << "\n";
+        return;
+    }
+
+    // Case 1 = Metrics to terminal, Case 2 = Errors to terminal
+    // Case 3 = Make report file
+    switch(command) 
+    {
+        case 4:
+            /**********************************************************************************
+             * If the csv file doesn't exist, create the header row, otherwise
+             * we just want to append new data */
+            times = fileTimes(result);
+            if(!std::filesystem::exists(output_file))
+            {
+                std::ofstream writecsv(output_file, std::ios::app);
+                writecsv << "File name, Last Accessed, Last Modified, Halstead's Total Operators,"
+                            << " Total Operands, Unique Operators, Unique Operands, Length, Vocabulary, Volume, Difficulty,"
+                            << " Effort\n";
+                writecsv << fileName << ", " << formatTime(times.access, result.timeFormat) << ", "
+                << formatTime(times.modify, result.timeFormat) << ", " << result.totalOperators << ", " << result.totalOperands 
+                << ", " << result.uniqueOperators.size() << ", " << result.uniqueOperands.size() << ", " << result.length << ", " << result.vocabulary 
+                << ", " << result.volume << ", " << result.difficulty << ", " << result.effort << "\n";
+            }
+            else
+            {
+                std::ofstream writecsv(output_file, std::ios::app);
+                writecsv << fileName << ", " << formatTime(times.access, result.timeFormat) << ", "
+                << formatTime(times.modify, result.timeFormat) << ", " << result.totalOperators << ", " << result.totalOperands 
+                << ", " << result.uniqueOperators.size() << ", " << result.uniqueOperands.size() << ", " << result.length << ", " << result.vocabulary 
+                << ", " << result.volume << ", " << result.difficulty << ", " << result.effort << "\n";
+            }
+            {
+                // Each subroutine is a row of a second csv file beside the first
+                std::string functionFile = std::filesystem::path(output_file).replace_filename("AEC_Functions.csv").string();
+                bool header = !std::filesystem::exists(functionFile);
+                std::ofstream writecsv(functionFile, std::ios::app);
+                if (header)
+                {
+                    writecsv << "File name, Subroutine, Line, Cyclomatic Complexity, Total Operators, Total Operands,"
+                             << " Unique Operators, Unique Operands, Length, Vocabulary, Volume, Difficulty, Effort\n";
+                }
+                for (auto& function : result.functions)
+                {
+                    writecsv << fileName << ", " << (function.name.empty() ? "(start)" : function.name) << ", " << function.line
+                    << ", " << function.cyclomatic << ", " << function.totalOperators << ", " << function.totalOperands
+                    << ", " << function.uniqueOperatorCount << ", " << function.uniqueOperandCount << ", " << function.length
+                    << ", " << function.vocabulary << ", " << function.volume << ", " << function.difficulty << ", " << function.effort << "\n";
+                }
+            }
+            break;
+
+        case 5:
+            if (writeIr(result, output_file))
+            {
+                std::cout << "Created binary IR file: " << output_file << "\n";
+            }
+            break;
+
+        case 1:
+            writeMetadata(result, std::cout);
+            std::cout << "********************************************************\nGeneral Metrics:\n";
+            std::cout << "\tNumber of full line comments: " << result.fullCommentLines << "\n";
+            std::cout << "\tNumber of blank lines: " << result.blankLines << "\n";
+            std::cout << "\tTotal number of lines: " << result.totalLines << "\n";
+            std::cout << "\tNumber of lines with comments: " << result.linesWComment << "\n";
+            std::cout << "\tNumber of lines without comments: " << result.linesWOComment << "\n";
+            std::cout << "\tTotal directives used: " << result.dirLines << "\n";
+            std::cout << "\tCyclomatic Complexity: " << result.cyclomatic << "\n";
+            std::cout << "********************************************************\n";
+            std::cout << "Halstead's Metrics:\n";
+            std::cout << "\tUnique operators: " << result.uniqueOperators.size() << "\n";
+            std::cout << "\tTotal operators: " << result.totalOperators << "\n";
+            std::cout << "\tUnique operands: " << result.uniqueOperands.size() << "\n";
+            std::cout << "\tTotal operands: " << result.totalOperands << "\n";
+            std::cout << "\tProgram Length: " << result.length << "\n";
+            std::cout << "\tProgram Vocabulary: " << result.vocabulary << "\n";
+            std::cout << "\tProgram Volume: " << result.volume << "\n";
+            std::cout << "\tProgram Difficulty: " << result.difficulty << "\n";
+            std::cout << "\tProgram Effort: " << result.effort << "\n";
+            std::cout << "********************************************************\n";
+            writeFunctions(result, std::cout);
+            std::cout << "********************************************************\n";
+            std::cout << "Register Use:\n";
+            for(int r = 0; r < result.model.registerCount; r++)
+            {
+                std::cout << "\tRegister " << r << " used at lines: ";
+                sorter.assign(result.registerUse[r].begin(), result.registerUse[r].end());
+                std::sort(sorter.begin(), sorter.end());    // Sort register use
+                for(auto& line : sorter)
+                {
+                    std::cout << line << " ";
+                }
+                std::cout << "\n";
+            }
+            std::cout << "********************************************************\n";
+            std::cout << "SVC Use:\n";
+            for(auto& line : result.svcUse)
+            {
+                std::cout << "\t" << line << "\n";
+            }
+            std::cout << "Subroutine Use:\n";
+            for(auto& line : result.subroutineUse)
+            {
+                std::cout << "\t" << line << "\n";
+            }
+            std::cout << "Branch Use:\n";
+            for(auto& line : result.branchUse)
+            {
+                std::cout << "\t" << line << "\n";
+            }
+            std::cout << "Directive Use:\n";
+            for (auto& map : result.directiveUse) 
+            {
+                std::cout << "\t" << map.first << " at lines: ";
+                for (size_t i = 0; i < map.second.size(); i++) 
+                {
+                    std::cout << map.second[i] << " ";
+                }
+                std::cout << "\n";
+            }
+            std::cout << "********************************************************\n";
+            std::cout << "Call Graph:\n";
+            for(auto& line : result.callGraphUse)
+            {
+                std::cout << "\t" << line << "\n";
+            }
+            std::cout << "********************************************************\n";
+            std::cout << "Addressing Modes:\n";
+            for(int mode = MODE_INDIRECT; mode < MODE_COUNT; mode++)
+            {
+                std::cout << (mode == MODE_INDIRECT ? "" : "\n") << "\tLines with " << addressModeNames[mode] << ": ";
+                for(int line : result.addressLines[mode])
+                {
+                    std::cout << line << " ";
+                }
+            }
+            std::cout << "\n********************************************************\n";
+            break;
+
+        case 2:
+            if (result.dataExists == false)
+            {
+                std::cout << fileName << ": Catastrophic error: Missing .data section. Error must be addressed before using AEC" << "\n";
+            }
+            else if (result.globalErrorFlag == true)
+            {
+                std::cout << fileName << ": Catastrophic error: .data section comes before .global. Error must be addressed before using AEC" << "\n";
+            }
+            else
+            {
+                writeMetadata(result, std::cout);
+                std::cout << "********************************************************\nErrors found:\n";
+            
+                writeErrors(result, std::cout, true);
+                std::cout << "********************************************************\n";
+            
+            }
+            break;
+
+        case 3:
+            if (result.dataExists == false)
+            {
+                std::cout << fileName << ": Catastrophic error: Missing .data section. Error must be addressed before using AEC" << "\n";
+            }
+            else if (result.globalErrorFlag == true)
+            {
+                std::cout << fileName << ": Catastrophic error: .data section comes before .global. Error must be addressed before using AEC" << "\n";
+            }
+            else
+            {
+                std::ofstream outfile(output_file);
+                writeMetadata(result, outfile);
+                outfile << "********************************************************\nGeneral Metrics:\n";
+                outfile << "\tNumber of full line comments: " << result.fullCommentLines << "\n";
+                outfile << "\tNumber of blank lines: " << result.blankLines << "\n";
+                outfile << "\tTotal number of lines: " << result.totalLines << "\n";
+                outfile << "\tNumber of lines with comments: " << result.linesWComment << "\n";
+                outfile << "\tNumber of lines without comments: " << result.linesWOComment << "\n";
+                outfile << "\tTotal directives used: " << result.dirLines << "\n";
+                outfile << "\tCyclomatic Complexity: " << result.cyclomatic << "\n";
+                outfile << "********************************************************\n";
+                outfile << "Halstead's Metrics:\n";
+                outfile << "\tUnique operators: " << result.uniqueOperators.size() << "\n";
+                outfile << "\tTotal operators: " << result.totalOperators << "\n";
+                outfile << "\tUnique operands: " << result.uniqueOperands.size() << "\n";
+                outfile << "\tTotal operands: " << result.totalOperands << "\n";
+                outfile << "\tProgram Length: " << result.length << "\n";
+                outfile << "\tProgram Vocabulary: " << result.vocabulary << "\n";
+                outfile << "\tProgram Volume: " << result.volume << "\n";
+                outfile << "\tProgram Difficulty: " << result.difficulty << "\n";
+                outfile << "\tProgram Effort: " << result.effort << "\n";
+                outfile << "********************************************************\n";
+                writeFunctions(result, outfile);
+                outfile << "********************************************************\n";
+                outfile << "Register Use:\n";
+                for(int r = 0; r < result.model.registerCount; r++)
+                {
+                    outfile << "\tRegister " << r << " used at lines: ";
+                    sorter.assign(result.registerUse[r].begin(), result.registerUse[r].end());
+                    std::sort(sorter.begin(), sorter.end());    // Sort register use
+                    for(auto& line : sorter)
                     {
-                        subtoken = token;   // Never edit the token
-                        subtoken.erase(subtoken.size() - 1);    // Cut off the :
-                        variables.push_back(subtoken);
+                        outfile << line << " ";
                     }
-                    /********************************************************************
-                     * If the token is not in the .data section and ends in a :
-                     * then it is a label defining a section of the program */
-                    else if(token.back() == ':' && dataFlag == false && numTokens == 1)
+                    outfile << "\n";
+                }
+                outfile << "********************************************************\n";
+                outfile << "SVC Use:\n";
+                for(auto& line : result.svcUse)
+                {
+                    outfile << "\t" << line << "\n";
+                }
+                outfile << "Subroutine Use:\n";
+                for(auto& line : result.subroutineUse)
+                {
+                    outfile << "\t" << line << "\n";
+                }
+                outfile << "Branch Use:\n";
+                for(auto& line : result.branchUse)
+                {
+                    outfile << "\t" << line << "\n";
+                }
+                outfile << "Directive Use:\n";
+                for (auto& map : result.directiveUse) 
+                {
+                    outfile << "\t" << map.first << " at lines: ";
+                    for (size_t i = 0; i < map.second.size(); i++) 
                     {
-                        numTokens--;
-                        subtoken = token; // Never edit the token
-                        subtoken.erase(subtoken.size() - 1);    // Cut off the :
-                        labels.push_back(subtoken);
-                        labelLineNum.push_back(totalLines); // The line the label starts at
-                        noReturnBranch = false; // Once a label is found code can be reached again
+                        outfile << map.second[i] << " ";
                     }
-                    /********************************************************************
-                     * If we are in the .equ section
-                     * then the second token in the line is a constant */
-                    else if(equFlag == true && numTokens == 2)
+                    outfile << "\n";
+                }
+                outfile << "********************************************************\n";
+                outfile << "Call Graph:\n";
+                for(auto& line : result.callGraphUse)
+                {
+                    outfile << "\t" << line << "\n";
+                }
+                outfile << "********************************************************\n";
+                outfile << "Addressing Modes:\n";
+                for(int mode = MODE_INDIRECT; mode < MODE_COUNT; mode++)
+                {
+                    outfile << (mode == MODE_INDIRECT ? "" : "\n") << "\tLines with " << addressModeNames[mode] << ": ";
+                    for(int line : result.addressLines[mode])
                     {
-                        subtoken = token; // Never edit the token
-                        subtoken.erase(subtoken.size() - 1); // Cut of the ,
-                        constants.push_back(subtoken);
+                        outfile << line << " ";
                     }
+                }
+                outfile << "\n********************************************************\n";
+
+                outfile << "Errors found:\n";
+
+                writeErrors(result, outfile, true);
+                outfile << "********************************************************\n";
+                outfile.close();
+
+
+                std::cout << "Created report file: " << output_file << "\n";
+            }
+            break;
+    }
+}
+
+/***************************************************************************
+ * projectReader treats every .s file in a folder as one program. Each file
+ * is analyzed once on its own thread, then a link step merges the symbol
+ * tables so labels shared through .global are resolved across files
+ * before the whole-file checks run and the reports are made. */
+void projectReader(std::string directory, const AnalysisOptions& options) {
+    std::vector<std::string> files;
+    std::vector<FileAnalysis> results;
+    ProjectSymbols project;
+
+    for (auto& file : assemblyFiles(directory)) files.push_back(file.path.string());
+    results.resize(files.size());
+
+    parallelFor(files.size(), [&](size_t i) { if (!analyzeFile(files[i], results[i], options)) exit(-1); });
+
+    /***************************************************************************
+     * Link step. Only the global labels can be seen by other files, so only
+     * uses and calls of those are carried over. */
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        for (auto& name : results[i].globals)
+        {
+            project.globalFile.emplace(name, i);
+        }
+    }
+    for (auto& result : results)
+    {
+        for (auto& operand : result.uniqueOperands)
+        {
+            if (project.globalFile.find(operand) != project.globalFile.end()) project.referenced.insert(operand);
+        }
+        for (auto& name : result.subroutines)
+        {
+            if (project.globalFile.find(name) != project.globalFile.end()) project.called.insert(name);
+        }
+    }
+
+    linkCallGraph(results, project);
+    parallelFor(results.size(), [&](size_t i) { finishAnalysis(results[i], &project); });
+
+    for (auto& result : results)
+    {
+        std::filesystem::path filePath(result.inputFile);
+        writeResults(result, "Reports/" + filePath.stem().string() + "_report.txt", 3);
+    }
+}
+
+/***************************************************************************
+ * assemblyFiles lists the .s files of a folder sorted by path. The order
+ * directory_iterator gives depends on the file system, so without this
+ * the same folder could be read, and its results written, in a different
+ * order on another machine or after a copy. With times, each file's are
+ * read as it is listed, relative to the open folder so the path isn't
+ * looked up again. */
+std::vector<DirectoryFile> assemblyFiles(const std::string& directory, bool times) {
+    std::vector<DirectoryFile> files;
+    int folder = times ? open(directory.c_str(), O_RDONLY | O_DIRECTORY) : -1;
+
+    for (auto& file : std::filesystem::directory_iterator(directory)) 
+    {
+        if (file.is_regular_file() && file.path().extension() == ".s")
+        {
+            files.push_back({file.path(), FileTimes()});
+            if (folder >= 0) readTimes(folder, file.path().filename().c_str(), files.back().times);
+        }
+    }
+    if (folder >= 0) close(folder);
+    std::sort(files.begin(), files.end(), [](const DirectoryFile& a, const DirectoryFile& b) { return a.path < b.path; });
+    return files;
+}
+
+/***************************************************************************
+ * parallelFor calls work once for every index below count, spread over
+ * one thread per core. Threads take the next index as they finish so a
+ * few large files don't hold up the rest. */
+void parallelFor(size_t count, const std::function<void(size_t)>& work) {
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    size_t threadCount = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+
+    for (size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&]()
+        {
+            for (size_t i = next++; i < count; i = next++)
+            {
+                work(i);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+/***************************************************************************
+ * hasConditionSuffix checks if an operator ends in one of the condition
+ * codes, like addeq or movgt. */
+bool hasConditionSuffix(const std::string& op)
+{
+    static const std::unordered_set<std::string> conditions = {
+        "eq", "ne", "cs", "hs", "cc", "lo", "mi", "pl", "vs", "vc",
+        "hi", "ls", "ge", "lt", "gt", "le", "al"};
+
+    if (op.size() < 3) return false;
+    std::string suffix = op.substr(op.size() - 2);
+    std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
+    return conditions.find(suffix) != conditions.end();
+}
+
+/***************************************************************************
+ * registerMask turns an operand into a mask of the registers it names.
+ * Brackets, braces, commas and writeback marks are stripped first, and a
+ * range like {r4-r7} names every register in between. */
+uint32_t Arm32::registerMask(const std::string& token)
+{
+    size_t start = token.find_first_not_of("[{");
+    size_t end = token.find_last_not_of(",]}!^");
+    if (start == std::string::npos || end == std::string::npos || end < start) return 0;
+
+    std::string name = token.substr(start, end - start + 1);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    // A range names every register from the first to the last
+    size_t dash = name.find('-');
+    if (dash != std::string::npos)
+    {
+        uint32_t low = registerMask(name.substr(0, dash));
+        uint32_t high = registerMask(name.substr(dash + 1));
+        if (low == 0 || high == 0 || high < low) return 0;
+        return uint32_t((high << 1) - low);
+    }
+
+    if (name == "sp") return 1u << 13;
+    if (name == "lr") return 1u << 14;
+    if (name == "pc") return 1u << 15;
+    if (name == "fp") return 1u << 11;
+    if (name == "ip") return 1u << 12;
+    if (name.size() < 2 || name.size() > 3 || name[0] != 'r') return 0;
+    if (!std::isdigit(static_cast<unsigned char>(name[1])) || (name.size() == 3 && !std::isdigit(static_cast<unsigned char>(name[2])))) return 0;
+
+    int number = std::stoi(name.substr(1));
+    if (number > 15) return 0;
+    return 1u << number;
+}
+
+/***************************************************************************
+ * registerNumber gives the number of a register written as r0-r15, or -1
+ * when the token is not a register. Used by the register use report. */
+int Arm32::registerNumber(const std::string& token)
+{
+    if (token.size() < 2 || token.size() > 3 || (token[0] != 'r' && token[0] != 'R')) return -1;
+    if (!std::isdigit(static_cast<unsigned char>(token[1])) ||
+        (token.size() == 3 && (token[1] == '0' || !std::isdigit(static_cast<unsigned char>(token[2]))))) return -1;
+
+    int number = std::stoi(token.substr(1));
+    return number > 15 ? -1 : number;
+}
+
+/***************************************************************************
+ * isMultiple tells if an operator is one of the load or store multiple
+ * names given, with or without a condition. */
+bool Arm32::isMultiple(const std::string& token, std::initializer_list<const char*> names)
+{
+    std::string op = token;
+    std::transform(op.begin(), op.end(), op.begin(), ::tolower);
+
+    for (const char* name : names)
+    {
+        size_t length = std::strlen(name);
+        if (op.compare(0, length, name) == 0 && (op.size() == length || (op.size() == length + 2 && hasConditionSuffix(op))))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/***************************************************************************
+ * classifyOperator fills in how control leaves an instruction and the
+ * registers the operator itself reads or loads. It returns how many of the
+ * leading operands are loaded with a value. */
+int Arm32::classifyOperator(const std::string& token, Instruction& instruction)
+{
+    std::string op = token;
+    std::transform(op.begin(), op.end(), op.begin(), ::tolower);
+
+    if (op[0] == 'b')
+    {
+        if (op == "b")
+        {
+            instruction.flow = FLOW_BRANCH;
+            return 0;
+        }
+        if (op == "bl" || op == "blx" || (op.size() == 4 && op.compare(0, 2, "bl") == 0 && hasConditionSuffix(op)))
+        {   // Arguments are passed in r0-r3
+            instruction.call = true;
+            instruction.argumentMask = argumentMask;
+            return 0;
+        }
+        if (op.compare(0, 2, "bx") == 0)
+        {
+            instruction.flow = FLOW_RETURN;
+            return 0;
+        }
+        if (op.size() == 3 && hasConditionSuffix(op))
+        {
+            instruction.flow = FLOW_COND_BRANCH;
+            return 0;
+        }
+    }
+
+    // Anything longer than a plain three letter operator may be conditional
+    instruction.conditional = op.size() > 3 && hasConditionSuffix(op);
+
+    if (op.compare(0, 3, "pop") == 0)
+    {
+        instruction.restore = true;
+        return 0;
+    }
+    if (op.compare(0, 3, "svc") == 0 || op.compare(0, 3, "swi") == 0)
+    {   // System calls read r0-r7 and hand back their result in r0
+        instruction.argumentMask = syscallMask;
+        instruction.defMask = 0x0001;
+        return 0;
+    }
+    if (op.compare(0, 3, "str") == 0 || op.compare(0, 3, "stm") == 0 || op.compare(0, 3, "ldm") == 0 ||
+        op.compare(0, 4, "push") == 0 || op.compare(0, 3, "cmp") == 0 || op.compare(0, 3, "cmn") == 0 ||
+        op.compare(0, 3, "tst") == 0 || op.compare(0, 3, "teq") == 0 || op.compare(0, 3, "nop") == 0)
+    {
+        return 0;
+    }
+    // ldrd and the long multiplies load a pair of registers
+    if (op.compare(0, 4, "ldrd") == 0 || op.compare(0, 5, "umull") == 0 || op.compare(0, 5, "smull") == 0 ||
+        op.compare(0, 5, "umlal") == 0 || op.compare(0, 5, "smlal") == 0)
+    {
+        return 2;
+    }
+    return 1;
+}
+
+/***************************************************************************
+ * Thumb adds cbz and cbnz, which read a register and branch to the label
+ * after it, and IT blocks, which load nothing themselves. */
+int Thumb::classifyOperator(const std::string& token, Instruction& instruction)
+{
+    std::string op = token;
+    std::transform(op.begin(), op.end(), op.begin(), ::tolower);
+
+    if (op == "cbz" || op == "cbnz")
+    {
+        instruction.flow = FLOW_COND_BRANCH;
+        return 0;
+    }
+    if (op.size() <= 4 && op.compare(0, 2, "it") == 0 && op.find_first_not_of("ite", 1) == std::string::npos)
+    {
+        return 0;
+    }
+    return Arm32::classifyOperator(token, instruction);
+}
+
+/***************************************************************************
+ * registerMask for AArch64. x0-x30 and w0-w30 share a bit, the zero
+ * registers name nothing, and sp gets the last bit. */
+uint32_t AArch64::registerMask(const std::string& token)
+{
+    size_t start = token.find_first_not_of("[{");
+    size_t end = token.find_last_not_of(",]}!");
+    if (start == std::string::npos || end == std::string::npos || end < start) return 0;
+
+    std::string name = token.substr(start, end - start + 1);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    if (name == "sp" || name == "wsp") return 1u << 31;
+    if (name == "fp") return 1u << 29;
+    if (name == "lr") return 1u << 30;
+
+    int number = registerNumber(name);
+    return number < 0 ? 0 : 1u << number;
+}
+
+/***************************************************************************
+ * registerNumber gives the number of a register written as x0-x30 or
+ * w0-w30, or -1 when the token is not a register. */
+int AArch64::registerNumber(const std::string& token)
+{
+    if (token.size() < 2 || token.size() > 3) return -1;
+    if (token[0] != 'x' && token[0] != 'X' && token[0] != 'w' && token[0] != 'W') return -1;
+    if (!std::isdigit(static_cast<unsigned char>(token[1])) ||
+        (token.size() == 3 && (token[1] == '0' || !std::isdigit(static_cast<unsigned char>(token[2]))))) return -1;
+
+    int number = std::stoi(token.substr(1));
+    return number > 30 ? -1 : number;
+}
+
+/***************************************************************************
+ * classifyOperator for AArch64. Conditional branches are written b.eq,
+ * calls through a register are blr, and ret returns through x30. */
+int AArch64::classifyOperator(const std::string& token, Instruction& instruction)
+{
+    std::string op = token;
+    std::transform(op.begin(), op.end(), op.begin(), ::tolower);
+
+    if (op == "b" || op == "br")
+    {
+        instruction.flow = FLOW_BRANCH;
+        return 0;
+    }
+    if (op == "bl" || op == "blr")
+    {   // Arguments are passed in x0-x7
+        instruction.call = true;
+        instruction.argumentMask = argumentMask;
+        return 0;
+    }
+    if (op == "ret")
+    {
+        instruction.flow = FLOW_RETURN;
+        return 0;
+    }
+    if (op.compare(0, 2, "b.") == 0 || op == "cbz" || op == "cbnz" || op == "tbz" || op == "tbnz")
+    {
+        instruction.flow = FLOW_COND_BRANCH;
+        return 0;
+    }
+    if (op == "svc")
+    {   // System calls take their number in x8 and hand back their result in x0
+        instruction.argumentMask = syscallMask;
+        instruction.defMask = 0x0001;
+        return 0;
+    }
+    if (op.compare(0, 2, "st") == 0 || op == "cmp" || op == "cmn" || op == "tst" ||
+        op == "ccmp" || op == "ccmn" || op == "nop" || op == "prfm")
+    {
+        return 0;
+    }
+    if (op.compare(0, 3, "ldp") == 0)
+    {
+        return 2;
+    }
+    return 1;
+}
+
+/***************************************************************************
+ * buildBlocks splits the instructions into basic blocks and links them by
+ * their branches. blockOf is filled with the block of every instruction.
+ * Subroutines are entered with their argument registers loaded. */
+std::vector<BasicBlock> buildBlocks(const std::vector<Instruction>& code, const std::unordered_map<std::string, size_t>& labelIndex,
+    const std::unordered_set<std::string>& subroutines, const RegisterModel& model, std::vector<size_t>& blockOf)
+{
+    std::vector<BasicBlock> blocks;
+    std::vector<bool> leader(code.size() + 1, false);
+
+    blockOf.assign(code.size() + 1, 0);
+    if (code.empty()) return blocks;
+
+    /***************************************************************************
+     * A block starts at the first instruction, at every label and right after
+     * any instruction that can jump away. */
+    leader[0] = true;
+    for (auto& label : labelIndex)
+    {
+        leader[label.second] = true;
+    }
+    for (size_t i = 0; i < code.size(); i++)
+    {
+        if (code[i].flow != FLOW_NEXT) leader[i + 1] = true;
+    }
+    for (size_t i = 0; i < code.size(); i++)
+    {
+        if (leader[i])
+        {
+            blocks.push_back(BasicBlock());
+            blocks.back().first = i;
+        }
+        blocks.back().last = i;
+        blockOf[i] = blocks.size() - 1;
+    }
+    blockOf[code.size()] = blocks.size();   // Falling off the end leaves the program
+
+    // Link each block to the blocks control can move to next
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        const Instruction& end = code[blocks[b].last];
+        if (end.flow == FLOW_NEXT || end.flow == FLOW_COND_BRANCH)
+        {
+            if (blocks[b].last + 1 < code.size()) blocks[b].successors.push_back(b + 1);
+        }
+        if (end.flow == FLOW_BRANCH || end.flow == FLOW_COND_BRANCH)
+        {
+            auto target = labelIndex.find(end.target);
+            if (target != labelIndex.end() && target->second < code.size())
+            {
+                blocks[b].successors.push_back(blockOf[target->second]);
+            }
+        }
+        for (size_t s : blocks[b].successors)
+        {
+            blocks[s].predecessors.push_back(b);
+        }
+    }
+    for (auto& label : labelIndex)
+    {
+        if (label.second < code.size() && subroutines.find(label.first) != subroutines.end())
+        {
+            blocks[blockOf[label.second]].entry = true;
+            blocks[blockOf[label.second]].entryMask = model.argumentMask;
+        }
+    }
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        if (b == 0 || blocks[b].predecessors.empty()) blocks[b].entry = true;
+        blocks[b].entryMask |= model.alwaysLoaded;
+    }
+
+    return blocks;
+}
+
+/***************************************************************************
+ * registerDataflow solves loaded registers and liveness over the basic
+ * blocks with register masks and a worklist. A register is loaded into a
+ * block only if it is loaded on every path into it, so a register read
+ * where some path never loaded it is used before being loaded. A load that no
+ * path ever reads is a dead store. Each block is only revisited when one
+ * of its neighbours changed, so the work stays close to linear in the size
+ * of the file. */
+void registerDataflow(const std::vector<Instruction>& code, std::vector<BasicBlock>& blocks, const RegisterModel& model,
+    std::vector<std::string>& registerError, std::vector<std::string>& deadStoreError)
+{
+    const uint32_t returnLive = model.returnLive;
+    const uint32_t checked = model.checked;
+    std::vector<size_t> worklist;
+    std::vector<bool> queued;
+    std::vector<std::pair<int, int>> deadStores;
+
+    /***************************************************************************
+     * Summarize each block once so the solver never has to walk its
+     * instructions again. A conditional load might not happen, so it never
+     * ends the life of the value that was already in the register. */
+    for (auto& block : blocks)
+    {
+        for (size_t i = block.first; i <= block.last; i++)
+        {
+            block.gen = uint32_t((block.gen & ~code[i].clobberMask) | code[i].defMask);
+            block.kill |= code[i].clobberMask | code[i].defMask;
+        }
+        for (size_t i = block.last + 1; i-- > block.first; )
+        {
+            uint32_t killed = code[i].clobberMask | (code[i].conditional ? 0 : code[i].defMask);
+            uint32_t read = code[i].useMask | code[i].argumentMask;
+            block.use = uint32_t((block.use & ~killed) | read);
+            block.def = uint32_t((block.def | killed) & ~read);
+        }
+    }
+
+    // Loaded registers, forward from every entry. Every block starts out
+    // with everything loaded and only loses registers, until the paths agree.
+    queued.assign(blocks.size(), true);
+    for (auto& block : blocks) block.out = 0xFFFFFFFF;
+    for (size_t b = blocks.size(); b-- > 0; ) worklist.push_back(b);
+    while (!worklist.empty())
+    {
+        size_t b = worklist.back();
+        worklist.pop_back();
+        queued[b] = false;
+
+        BasicBlock& block = blocks[b];
+        block.in = block.entry ? block.entryMask : 0xFFFFFFFF;
+        for (size_t p : block.predecessors) block.in &= blocks[p].out;
+
+        uint32_t out = uint32_t((block.in & ~block.kill) | block.gen);
+        if (out != block.out)
+        {
+            block.out = out;
+            for (size_t s : block.successors)
+            {
+                if (!queued[s])
+                {
+                    queued[s] = true;
+                    worklist.push_back(s);
+                }
+            }
+        }
+    }
+
+    // Liveness, backward from every return
+    queued.assign(blocks.size(), true);
+    for (size_t b = 0; b < blocks.size(); b++) worklist.push_back(b);
+    while (!worklist.empty())
+    {
+        size_t b = worklist.back();
+        worklist.pop_back();
+        queued[b] = false;
+
+        BasicBlock& block = blocks[b];
+        const Instruction& end = code[block.last];
+        block.liveOut = 0;
+        if (end.flow == FLOW_RETURN) block.liveOut = returnLive;
+        else if (block.successors.empty() && end.flow == FLOW_BRANCH) block.liveOut = 0xFFFFFFFF;  // Unknown target
+        for (size_t s : block.successors) block.liveOut |= blocks[s].liveIn;
+
+        uint32_t liveIn = uint32_t((block.liveOut & ~block.def) | block.use);
+        if (liveIn != block.liveIn)
+        {
+            block.liveIn = liveIn;
+            for (size_t p : block.predecessors)
+            {
+                if (!queued[p])
+                {
+                    queued[p] = true;
+                    worklist.push_back(p);
+                }
+            }
+        }
+    }
+
+    /***************************************************************************
+     * Walk each block once with its solved masks to place the errors on
+     * the exact lines they happen. */
+    for (auto& block : blocks)
+    {
+        uint32_t loaded = block.in;
+        for (size_t i = block.first; i <= block.last; i++)
+        {
+            uint32_t missing = code[i].useMask & ~loaded & checked;
+            for (int r = 0; r < 32; r++)
+            {
+                if (missing & (1 << r))
+                {
+                    registerError.push_back("Register " + std::to_string(r) + " used before being loaded at line "
+                    + std::to_string(code[i].line));
+                }
+            }
+            loaded = uint32_t((loaded & ~code[i].clobberMask) | code[i].defMask);
+        }
 
-                    if(pushFlag == true && numTokens != 1)
-                    {
-                        pushNum++;
-                    }
-                    else if(popFlag == true && numTokens != 1)
-                    {
-                        popNum++;
-                    }
+        uint32_t live = block.liveOut;
+        for (size_t i = block.last + 1; i-- > block.first; )
+        {
+            uint32_t dead = code[i].defMask & ~live & checked;
+            if (code[i].restore == false && code[i].argumentMask == 0 && code[i].flow == FLOW_NEXT)
+            {
+                for (int r = 0; r < 32; r++)
+                {
+                    if (dead & (1 << r)) deadStores.push_back({code[i].line, r});
                 }
             }
+            uint32_t killed = code[i].clobberMask | (code[i].conditional ? 0 : code[i].defMask);
+            live = uint32_t((live & ~killed) | code[i].useMask | code[i].argumentMask);
         }
+    }
 
-        /*******************************************************************
-         *              START LINE BASED CHECKS HERE        */
+    std::sort(deadStores.begin(), deadStores.end());
+    for (auto& store : deadStores)
+    {
+        deadStoreError.push_back("Value loaded into register " + std::to_string(store.second) + " at line "
+        + std::to_string(store.first) + " is never used");
+    }
+}
 
-        /*******************************************************************
-         * Addressing modes, moved to lines to deal with bad flagging.
-         * Ordered by simplicity of check.*/
-        if(ldrFlag == true || strFlag == true)
+/***************************************************************************
+ * callGraph builds the caller to callee edges of every subroutine and walks
+ * each one along all of its paths, counting the registers pushed and
+ * popped. A subroutine has to return with everything it pushed popped and
+ * reach every line with the same number of pushed registers. The deepest
+ * stack along the call graph and any recursion are reported as well.
+ * Each subroutine is walked once, then the depths are added up callees
+ * first with an explicit stack, so a long chain of calls can't overflow
+ * it. In a project, calls to other files use their linked summaries.
+ * With exported, the summaries are copied out for linking instead. */
+void callGraph(const std::vector<Instruction>& code, const std::vector<BasicBlock>& blocks, const std::vector<size_t>& blockOf,
+    const std::unordered_map<std::string, size_t>& labelIndex, const std::vector<std::string>& labels,
+    const std::unordered_set<std::string>& subroutines, const ProjectSymbols* project,
+    std::unordered_map<std::string, Subroutine>* exported, std::vector<std::string>& callGraphUse,
+    std::vector<std::string>& stackError)
+{
+    std::unordered_map<std::string, Subroutine> summaries;
+    std::unordered_map<size_t, std::string> entryName;  // Entry block to the subroutine it starts
+    std::vector<std::string> order;
+
+    if (code.empty()) return;
+
+    // The first instruction starts the program, every bl target starts a subroutine
+    for (auto& label : labels)
+    {
+        auto index = labelIndex.find(label);
+        if (index == labelIndex.end() || index->second >= code.size()) continue;
+        if (index->second == 0 || subroutines.find(label) != subroutines.end())
+        {
+            summaries[label].name = label;
+            summaries[label].entryBlock = blockOf[index->second];
+            entryName[blockOf[index->second]] = label;
+            order.push_back(label);
+        }
+    }
+
+    /***************************************************************************
+     * Walk each subroutine's own blocks, keeping its pushes and calls */
+    for (auto& name : order)
+    {
+        Subroutine& sub = summaries[name];
+        std::unordered_map<size_t, int> depthAt;    // Pushed registers when a block is entered
+        std::unordered_set<std::string> called;
+        std::vector<size_t> worklist;
+        bool overPopped = false, unbalanced = false, returnPushed = false;
+
+        depthAt[sub.entryBlock] = 0;
+        worklist.push_back(sub.entryBlock);
+        while (!worklist.empty())
+        {
+            size_t b = worklist.back();
+            worklist.pop_back();
+            int depth = depthAt[b];
+
+            for (size_t i = blocks[b].first; i <= blocks[b].last; i++)
+            {
+                depth += code[i].stackDelta;
+                if (depth < 0 && overPopped == false)
+                {
+                    overPopped = true;
+                    stackError.push_back(name + " pops more registers than it pushed at line " + std::to_string(code[i].line));
+                }
+                sub.maxDepth = std::max(sub.maxDepth, depth);
+
+                if (code[i].call == false) continue;
+                if (called.insert(code[i].target).second) sub.callees.push_back(code[i].target);
+                sub.calls.push_back({code[i].target, name, depth, code[i].line});
+            }
+
+            const Instruction& end = code[blocks[b].last];
+            if (end.flow == FLOW_RETURN && depth > 0 && returnPushed == false)
+            {
+                returnPushed = true;
+                stackError.push_back(name + " returns with " + std::to_string(depth)
+                + " pushed registers still on the stack at line " + std::to_string(end.line));
+            }
+            for (size_t s : blocks[b].successors)
+            {
+                // Falling into another subroutine leaves this one
+                if (s != sub.entryBlock && entryName.find(s) != entryName.end()) continue;
+
+                auto seen = depthAt.find(s);
+                if (seen == depthAt.end())
+                {
+                    depthAt[s] = depth;
+                    worklist.push_back(s);
+                }
+                else if (seen->second != depth && unbalanced == false)
+                {
+                    unbalanced = true;
+                    stackError.push_back(name + " reaches line " + std::to_string(code[blocks[s].first].line)
+                    + " with different numbers of pushed registers");
+                }
+            }
+        }
+    }
+
+    /***************************************************************************
+     * Add the depth of every callee at the depth it is called at. A frame
+     * is a subroutine and the next of its calls to look at; a call to a
+     * subroutine not yet done pushes it and is looked at again after it. */
+    std::vector<std::pair<Subroutine*, size_t>> stack;
+    for (auto& name : order)
+    {
+        if (summaries[name].state != 0) continue;
+        summaries[name].state = 1;
+        stack.push_back({&summaries[name], 0});
+        while (!stack.empty())
+        {
+            Subroutine& sub = *stack.back().first;
+            size_t& next = stack.back().second;
+            if (next == sub.calls.size())
+            {
+                sub.state = 2;
+                stack.pop_back();
+                continue;
+            }
+            const CallSite& call = sub.calls[next];
+            auto callee = summaries.find(call.target);
+            const Subroutine* done = callee != summaries.end() ? &callee->second : nullptr;
+            if (done != nullptr && done->state == 0)
+            {
+                callee->second.state = 1;
+                stack.push_back({&callee->second, 0});
+                continue;
+            }
+            next++;
+            if (done != nullptr && done->state == 1)
+            {
+                callee->second.recursive = true;
+                sub.recursive = true;
+                stackError.push_back("Recursive call to " + call.target + " from " + sub.name + " at line "
+                + std::to_string(call.line));
+                continue;
+            }
+            if (done == nullptr)
+            {
+                if (exported != nullptr) sub.external.push_back(call);
+                if (project == nullptr) continue;
+                auto linked = project->summaries.find(call.target);
+                if (linked == project->summaries.end()) continue;  // Library routines like printf
+                done = &linked->second;
+            }
+            sub.maxDepth = std::max(sub.maxDepth, call.depth + done->maxDepth);
+            if (done->recursive) sub.recursive = true;
+            if (exported != nullptr && done->state == 2 && callee != summaries.end())
+            {
+                for (auto& far : done->external) sub.external.push_back({far.target, far.caller, call.depth + far.depth, far.line});
+            }
+        }
+    }
+
+    if (exported != nullptr)
+    {
+        *exported = std::move(summaries);
+        return;
+    }
+    for (auto& name : order)
+    {
+        const Subroutine& sub = summaries[name];
+        std::string line = name + " (stack depth " + std::to_string(sub.maxDepth)
+            + (sub.recursive ? "+ registers, recursive" : " registers") + ") calls: ";
+        for (auto& callee : sub.callees)
+        {
+            line += callee + " ";
+        }
+        callGraphUse.push_back(line);
+    }
+}
+
+/***************************************************************************
+ * linkCallGraph links the call graphs of every file of a project. Each
+ * file's subroutines are summarized on their own first, then the global
+ * ones are joined through the calls that leave their file, callees first
+ * with an explicit stack like in one file. A cycle through several files
+ * is reported in the file of the call that closes it. */
+void linkCallGraph(std::vector<FileAnalysis>& results, ProjectSymbols& project) {
+    std::vector<std::unordered_map<std::string, Subroutine>> summaries(results.size());
+
+    parallelFor(results.size(), [&](size_t i)
+    {
+        FileAnalysis& result = results[i];
+        std::vector<size_t> blockOf;
+        std::vector<std::string> uses, errors;
+        for (auto& name : result.globals)
+        {
+            if (project.called.find(name) != project.called.end()) result.subroutines.insert(name);
+        }
+        std::vector<BasicBlock> blocks = buildBlocks(result.code, result.labelIndex, result.subroutines, result.model, blockOf);
+        callGraph(result.code, blocks, blockOf, result.labelIndex, result.labels, result.subroutines, nullptr,
+            &summaries[i], uses, errors);
+    });
+    for (auto& global : project.globalFile)
+    {
+        auto found = summaries[global.second].find(global.first);
+        if (found == summaries[global.second].end()) continue;
+        project.summaries[global.first] = std::move(found->second);
+        project.summaries[global.first].state = 0;
+    }
+
+    std::vector<std::pair<Subroutine*, size_t>> stack;
+    for (auto& root : project.summaries)
+    {
+        if (root.second.state != 0) continue;
+        root.second.state = 1;
+        stack.push_back({&root.second, 0});
+        while (!stack.empty())
         {
-            if (linePreComment.find("=") != std::string::npos)
+            Subroutine& sub = *stack.back().first;
+            size_t& next = stack.back().second;
+            if (next == sub.external.size())
             {
-                pcLiteralMode.push_back(std::to_string(totalLines));
+                sub.state = 2;
+                stack.pop_back();
+                continue;
             }
-            else if(numTokens == 3) 
+            const CallSite& call = sub.external[next];
+            auto callee = project.summaries.find(call.target);
+            if (callee != project.summaries.end() && callee->second.state == 0)
             {
-                indirectMode.push_back(std::to_string(totalLines));
+                callee->second.state = 1;
+                stack.push_back({&callee->second, 0});
+                continue;
             }
-            else if(linePreComment.find("!") != std::string::npos)
+            next++;
+            if (callee == project.summaries.end()) continue;
+            if (callee->second.state == 1)
             {
-                preIndexMode.push_back(std::to_string(totalLines));
+                callee->second.recursive = true;
+                sub.recursive = true;
+                results[project.globalFile[sub.name]].stackError.push_back("Recursive call to " + call.target + " from "
+                + call.caller + " at line " + std::to_string(call.line));
+                continue;
             }
-            else if(linePreComment.find("PC") != std::string::npos || linePreComment.find("pc") != std::string::npos) 
+            sub.maxDepth = std::max(sub.maxDepth, call.depth + callee->second.maxDepth);
+            if (callee->second.recursive) sub.recursive = true;
+        }
+    }
+}
+
+/***************************************************************************
+ * loadRules compiles a rules file into the rule set. Each line is a
+ * keyword followed by names, # starts a comment:
+ *      disable <rule>...           enable <rule>...
+ *      unwanted <instruction>...   restricted <register>...
+ *      string-exception <text>...
+ * A list given in the file replaces the one built into the instruction
+ * set. Returns false after printing the problem to log if the file is bad. */
+bool loadRules(const std::string& rulesFile, RuleSet& rules, std::ostream& log) {
+    std::ifstream infile(rulesFile);
+    std::string line, keyword, name;
+    int lineNum = 0;
+    bool exceptionsGiven = false;
+
+    if (!infile.is_open())
+    {
+        log << "Error: Failed to open rules file: " << rulesFile << "\n";
+        return false;
+    }
+
+    while (std::getline(infile, line))
+    {
+        lineNum++;
+        if (line.find('#') != std::string::npos) line.erase(line.find('#'));
+        std::istringstream iss(line);
+        if (!(iss >> keyword)) continue;
+        if (keyword != "enable" && keyword != "disable" && keyword != "unwanted" &&
+            keyword != "restricted" && keyword != "string-exception")
+        {
+            log << rulesFile << ": Unknown keyword " << keyword << " at line " << lineNum << "\n";
+            return false;
+        }
+
+        while (iss >> name)
+        {
+            if (keyword == "enable" || keyword == "disable")
             {
-                pcRelativeMode.push_back(std::to_string(totalLines));
+                int rule = std::find(ruleNames, ruleNames + RULE_COUNT, name) - ruleNames;
+                if (rule == RULE_COUNT)
+                {
+                    log << rulesFile << ": Unknown rule " << name << " at line " << lineNum << "\n";
+                    return false;
+                }
+                if (keyword == "enable") rules.enabled |= 1u << rule;
+                else rules.enabled &= ~(1u << rule);
             }
-            else if(numTokens == 4 && token.back() == ']')
+            else if (keyword == "unwanted")
             {
-                indirectOffsetMode.push_back(std::to_string(totalLines));
+                rules.customUnwanted = true;
+                rules.unwanted.insert(name);
             }
-            else if(numTokens == 4 && token.back() != ']' && token.back() != '!')
+            else if (keyword == "restricted")
             {
-                postIndexMode.push_back(std::to_string(totalLines));
+                rules.customRestricted = true;
+                rules.restricted.insert(name);
             }
             else
-                unsureMode.push_back(std::to_string(totalLines));
+            {
+                if (exceptionsGiven == false) rules.stringExceptions.clear();
+                exceptionsGiven = true;
+                rules.stringExceptions.push_back(name);
+            }
         }
-        
-        /********************************************************************
-         * If the token is within the .data section. We validate the line has
-         * a quote to define a string, then check if it ends in \ n 
-         * We seperate this section from others because it works with the
-         * whole line.*/
-        if(dataFlag == true)
-        {  
-            // Ignore common .data elements that would flag like numInputPattern:
-            if(line.find("numInputPattern:") == std::string::npos &&
-            line.find("strInputPattern:") == std::string::npos &&
-            line.find("strInputError:") == std::string::npos)
-            {   // Check that the line has a quote but doesn't end a quote with \n"
-                if(line.find('"') != std::string::npos && line.find("\\n\"") == std::string::npos) 
+    }
+
+    return true;
+}
+
+/***************************************************************************
+ * compileOperators gives each mnemonic of each instruction set an id and
+ * works out its checks once, in both cases and with every condition and
+ * s suffix, plus the rules file's unwanted instructions. Called once the
+ * rules are loaded, a file read before only works its operators out.
+ * Rule sets without their own unwanted list share tables built once. */
+void compileOperators(RuleSet& rules) {
+    static const char* const armMnemonics[] = {
+        "mov", "mvn", "add", "adc", "sub", "sbc", "rsb", "rsc", "mul", "mla", "mls", "umull", "smull", "umlal",
+        "smlal", "sdiv", "udiv", "and", "orr", "eor", "bic", "orn", "tst", "teq", "cmp", "cmn", "lsl", "lsr",
+        "asr", "ror", "rrx", "ldr", "ldrb", "ldrh", "ldrsb", "ldrsh", "ldrd", "ldrex", "str", "strb", "strh",
+        "strd", "strex", "ldm", "ldmia", "ldmib", "ldmda", "ldmdb", "ldmfd", "ldmfa", "ldmed", "ldmea", "stm",
+        "stmia", "stmib", "stmda", "stmdb", "stmfd", "stmfa", "stmed", "stmea", "push", "pop", "b", "bl",
+        "bx", "blx", "svc", "swi", "ltm", "adr", "clz", "nop", "cbz", "cbnz", "it", "ite", "itt", "itet"};
+    static const char* const aarch64Mnemonics[] = {
+        "mov", "movz", "movk", "movn", "mvn", "add", "adds", "sub", "subs", "adc", "sbc", "mul", "madd",
+        "msub", "neg", "sdiv", "udiv", "and", "ands", "orr", "eor", "bic", "lsl", "lsr", "asr", "ror", "cmp",
+        "cmn", "tst", "ldr", "ldrb", "ldrh", "ldrsb", "ldrsh", "ldrsw", "ldur", "ldp", "str", "strb", "strh",
+        "stur", "stp", "adr", "adrp", "b", "bl", "br", "blr", "ret", "cbz", "cbnz", "tbz", "tbnz", "svc",
+        "csel", "cset", "csinc", "sxtw", "uxtb", "nop"};
+    static const char* const conditions[] = {
+        "", "eq", "ne", "cs", "hs", "cc", "lo", "mi", "pl", "vs", "vc", "hi", "ls", "ge", "lt", "gt", "le", "al"};
+
+    auto build = [](const RuleSet& from)
+    {
+        auto tables = std::make_shared<std::vector<OperatorTable>>(ISA_AARCH64 + 1);
+        auto add = [&](OperatorTable& table, std::string op, uint32_t (*checks)(const std::string&, const RuleSet&))
+        {
+            for (int upper = 0; upper < 2; upper++)
+            {
+                if (upper) std::transform(op.begin(), op.end(), op.begin(), ::toupper);
+                if (table.ids.emplace(op, uint16_t(table.checks.size())).second) table.checks.push_back(checks(op, from));
+            }
+        };
+        for (IsaProfile isa : {ISA_ARM32, ISA_THUMB})
+        {
+            auto checks = isa == ISA_THUMB ? &operatorChecks<Thumb> : &operatorChecks<Arm32>;
+            for (const char* mnemonic : armMnemonics)
+            {
+                for (const char* condition : conditions)
                 {
-                    stringError.push_back("String did not end with \\n at line " + std::to_string(totalLines));
+                    add((*tables)[isa], std::string(mnemonic) + condition, checks);
+                    add((*tables)[isa], std::string(mnemonic) + "s" + condition, checks);
                 }
             }
         }
+        for (const char* mnemonic : aarch64Mnemonics) add((*tables)[ISA_AARCH64], mnemonic, &operatorChecks<AArch64>);
+        for (const char* condition : conditions) add((*tables)[ISA_AARCH64], std::string("b.") + condition, &operatorChecks<AArch64>);
+        for (auto& name : from.unwanted)
+        {
+            add((*tables)[ISA_ARM32], name, &operatorChecks<Arm32>);
+            add((*tables)[ISA_THUMB], name, &operatorChecks<Thumb>);
+            add((*tables)[ISA_AARCH64], name, &operatorChecks<AArch64>);
+        }
+        return std::shared_ptr<const std::vector<OperatorTable>>(tables);
+    };
+    static const std::shared_ptr<const std::vector<OperatorTable>> defaults = build(RuleSet());
+
+    rules.operators = rules.customUnwanted ? build(rules) : defaults;
+}
+
+/***************************************************************************
+ * fileTimes gets the last access and modify times of the file, from the
+ * corpus reader if it already read them. */
+FileTimes fileTimes(const FileAnalysis& result) {
+    FileTimes times = result.times;
+
+    if (!times.read) readTimes(AT_FDCWD, result.inputFile.c_str(), times);
+    return times;
+}
+
+/***************************************************************************
+ * readTimes reads the times of name, relative to the folder open as
+ * directory. statx is asked for only the two times, and not to sync them
+ * on network file systems; stat is used where there is no statx. */
+bool readTimes(int directory, const char* name, FileTimes& times) {
+#ifdef STATX_ATIME
+    struct statx file_statx;
+    if (statx(directory, name, AT_STATX_DONT_SYNC, STATX_ATIME | STATX_MTIME, &file_statx) == 0)
+    {
+        times.read = true;
+        times.access = file_statx.stx_atime.tv_sec;
+        times.modify = file_statx.stx_mtime.tv_sec;
+        return true;
+    }
+#endif
+    struct stat file_stat;
+    if (fstatat(directory, name, &file_stat, 0) != 0) return false;
+    times.read = true;
+    times.access = file_stat.st_atime;
+    times.modify = file_stat.st_mtime;
+    return true;
+}
+
+/***************************************************************************
+ * formatTime writes a time as text, like ctime without its newline, ISO-8601
+ * or seconds since the epoch. The date is worked out here from the local
+ * offset, so no thread waits on the lock localtime takes. */
+std::string formatTime(std::time_t time, int format) {
+    static const char* const days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    char text[96];
+
+    if (format == TIME_EPOCH) return std::to_string(static_cast<long long>(time));
+
+    // Days to the civil date, from Howard Hinnant's days_from_civil inverse
+    long offset = localOffset(time);
+    long long local = static_cast<long long>(time) + offset;
+    long long day = local >= 0 ? local / 86400 : (local - 86399) / 86400;
+    long long second = local - day * 86400;
+    long long shifted = day + 719468;
+    long long era = (shifted >= 0 ? shifted : shifted - 146096) / 146097;
+    long long dayOfEra = shifted - era * 146097;
+    long long yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    long long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    long long monthIndex = (5 * dayOfYear + 2) / 153;
+    int dayOfMonth = int(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+    int month = int(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+    long long year = yearOfEra + era * 400 + (month <= 2);
+    int weekday = int(((day + 4) % 7 + 7) % 7);
+
+    if (format == TIME_ISO)
+    {
+        long zone = offset < 0 ? -offset : offset;
+        snprintf(text, sizeof(text), "%04lld-%02d-%02dT%02lld:%02lld:%02lld%c%02ld:%02ld", year, month, dayOfMonth,
+            second / 3600, second / 60 % 60, second % 60, offset < 0 ? '-' : '+', zone / 3600, zone / 60 % 60);
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "%s %s %2d %02lld:%02lld:%02lld %lld", days[weekday], months[month - 1], dayOfMonth,
+            second / 3600, second / 60 % 60, second % 60, year);
+    }
+    return text;
+}
+
+/***************************************************************************
+ * localOffset is the local time zone's offset from UTC at a time, in
+ * seconds. A zone changes offset a few times a year at most, so each
+ * thread keeps the offset of the UTC days it asked for, found once by
+ * calling localtime_r, which locks, at both ends of the day. A day the
+ * ends don't agree on has a change in it and is asked about every time. */
+long localOffset(std::time_t time) {
+    struct CachedOffset
+    {
+        long long day = INT64_MIN;
+        long offset = 0;
+        bool changes = false;     // The offset changes during the day
+    };
+    thread_local CachedOffset cache[256];
+    auto offsetAt = [](std::time_t at)
+    {
+        struct tm local;
+        return localtime_r(&at, &local) != nullptr ? long(local.tm_gmtoff) : 0L;
+    };
+    long long day = time >= 0 ? time / 86400 : (time - 86399) / 86400;
+    CachedOffset& entry = cache[day & 255];
+
+    if (entry.day != day)
+    {
+        entry.day = day;
+        entry.offset = offsetAt(std::time_t(day * 86400));
+        entry.changes = offsetAt(std::time_t(day * 86400 + 86399)) != entry.offset;
+    }
+    return entry.changes ? offsetAt(time) : entry.offset;
+}
+
+/***************************************************************************
+ * writeMetadata writes the metadata block every report starts with. */
+void writeMetadata(const FileAnalysis& result, std::ostream& out) {
+    std::string TOOL_VERSION = "1.0";
+    std::string TOOL_DATE = "4/27/2024";
+    std::string fileName = std::filesystem::path(result.inputFile).filename().string();
+
+    FileTimes times = fileTimes(result);
+    out << "********************************************************\nMetadata:\n";
+    out << "\tFile Name: " << fileName << "\n";
+    out << "\tLast accessed: " << formatTime(times.access, result.timeFormat) << "\n";
+    out << "\tLast modified: " << formatTime(times.modify, result.timeFormat) << "\n";
+    out << "\tTool Version: " << TOOL_VERSION << "\n";
+    out << "\tTool Date: " << TOOL_DATE << "\n";
+}
+
+/***************************************************************************
+ * writeFunctions writes Halstead's and cyclomatic complexity of every
+ * subroutine as a table, the highest effort first so the functions most
+ * worth a look are at the top. */
+void writeFunctions(const FileAnalysis& result, std::ostream& out) {
+    std::vector<const FunctionMetrics*> order;
+    char row[256];
+
+    for (auto& function : result.functions) order.push_back(&function);
+    std::stable_sort(order.begin(), order.end(), [](const FunctionMetrics* a, const FunctionMetrics* b) { return a->effort > b->effort; });
+
+    out << "Subroutine Metrics:\n";
+    snprintf(row, sizeof(row), "\t%-24s %6s %5s %13s %15s %12s %10s %14s\n", "Subroutine", "Line", "Cyclo",
+        "Operators", "Operands", "Volume", "Difficulty", "Effort");
+    out << row;
+    for (auto function : order)
+    {
+        snprintf(row, sizeof(row), "\t%-24s %6d %5d %5d/%-7d %6d/%-8d %12.1f %10.1f %14.1f\n",
+            function->name.empty() ? "(start)" : function->name.c_str(), function->line, function->cyclomatic,
+            function->uniqueOperatorCount, function->totalOperators, function->uniqueOperandCount,
+            function->totalOperands, function->volume, function->difficulty, function->effort);
+        out << row;
+    }
+}
+
+/***************************************************************************
+ * writeErrors writes the errors found in a file, one per line. summary
+ * adds the checks of the whole file, like the exit and push/pop counts,
+ * which streaming mode only knows once the file has been read. */
+void writeErrors(const FileAnalysis& result, std::ostream& out, bool summary) {
+    if (summary == true)
+    {
+        if (result.exitExists == false && (result.enabledRules >> RULE_NO_EXIT & 1))
+        {
+            out << "\tNo proper exit, svc 0, from program before .data section\n";
+        }
+        if(!(result.enabledRules >> RULE_PUSH_POP_COUNT & 1))
+        {   // Counting pushes and pops was turned off by the rules file
+        }
+        else if(result.pushNum > result.popNum)
+        {
+            out << "\tMore pushes detected than pops. Ensure that all values are popped off the heap.\n";
+        }
+        else if(result.pushNum < result.popNum)
+        {
+            out << "\tMore pops detected than pushes. Ensure that there is always a value on the heap before a Pop.\n";
+        }
+    }
+
+    for(auto& line : result.stringError)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.unwantedInstructions)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.restrictedError)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.unusedConditional)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.unusedLabel)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.unusedVariable)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.unusedConstant)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.isolatedCode)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.noReturnError)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.lrSaveError)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.branchOutError)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.stackError)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.registerError)
+    {
+        out << "\t" << line << "\n";
+    }
+    for(auto& line : result.deadStoreError)
+    {
+        out << "\t" << line << "\n";
+    }
+}
+
+/***************************************************************************
+ * writeIr writes the binary IR of an analyzed file, before finishAnalysis.
+ * Strings used more than once, like operators and registers, are stored
+ * once. The text and its lines are only written if they were kept, with
+ * --ir-text. */
+bool writeIr(const FileAnalysis& result, const std::string& output_file) {
+    std::vector<IrString> lines, operands;
+    std::vector<IrInstruction> instructions;
+    std::vector<IrLabel> labels;
+    std::vector<IrDirective> directives;
+    std::vector<IrFinding> findings;
+    std::vector<IrString> sourceFiles;
+    std::string strings;
+    std::unordered_map<std::string, IrString> stringIndex;
+    AnalysisArchive analysis;
+    IrHeader header = {};
+
+    auto addString = [&](const std::string& text) -> IrString
+    {
+        auto found = stringIndex.find(text);
+        if (found != stringIndex.end()) return found->second;
+        IrString s = {uint32_t(strings.size()), uint32_t(text.size())};
+        strings += text;
+        stringIndex.emplace(text, s);
+        return s;
+    };
+
+    for (size_t pos = 0; pos < result.sourceText.size(); )
+    {
+        size_t end = result.sourceText.find('\n', pos);
+        if (end == std::string::npos) end = result.sourceText.size();
+        lines.push_back({uint32_t(pos), uint32_t(end - pos)});
+        pos = end + 1;
+    }
+    for (auto& instruction : result.code)
+    {
+        IrInstruction record = {};
+        record.line = instruction.line;
+        record.op = addString(instruction.op);
+        record.firstOperand = operands.size();
+        record.operandCount = instruction.operands.size();
+        for (auto& operand : instruction.operands) operands.push_back(addString(operand));
+        record.useMask = instruction.useMask;
+        record.argumentMask = instruction.argumentMask;
+        record.defMask = instruction.defMask;
+        record.clobberMask = instruction.clobberMask;
+        record.stackDelta = instruction.stackDelta;
+        record.flow = instruction.flow;
+        record.conditional = instruction.conditional;
+        record.restore = instruction.restore;
+        record.call = instruction.call;
+        record.mode = instruction.mode;
+        record.target = addString(instruction.target);
+        instructions.push_back(record);
+    }
+    for (size_t i = 0; i < result.labels.size(); i++)
+    {
+        auto index = result.labelIndex.find(result.labels[i]);
+        labels.push_back({addString(result.labels[i]), uint32_t(result.labelLineNum[i]),
+            uint32_t(index != result.labelIndex.end() ? index->second : result.code.size())});
+    }
+    for (auto& directive : result.directiveUse)
+    {
+        for (int line : directive.second) directives.push_back({addString(directive.first), uint32_t(line)});
+    }
+    std::sort(directives.begin(), directives.end(), [](const IrDirective& a, const IrDirective& b) { return a.line < b.line; });
+    for (auto& name : result.sourceFiles) sourceFiles.push_back(addString(name));
+
+    // A finding is the format of its list that makes the message again, or the message itself
+    for (uint32_t list = 0; list < findingListCount; list++)
+    {
+        for (auto& message : result.*findingLists[list])
+        {
+            IrFinding record = {FINDING_COUNT + list, 0, {}};
+            size_t at = message.rfind(" at line ");
+            for (uint32_t kind = 0; at != std::string::npos && kind < FINDING_COUNT; kind++)
+            {
+                const FindingFormat& format = findingFormats[kind];
+                size_t before = std::strlen(format.before), after = std::strlen(format.after);
+                if (format.list != findingLists[list] || at < before + after || message.compare(0, before, format.before) != 0) continue;
+                std::string operand = message.substr(before, at - before - after);
+                int line = std::atoi(message.c_str() + at + 9);
+                if (findingText(Finding(kind), operand, line) != message) continue;
+                record = {kind, uint32_t(line), addString(operand)};
+                break;
+            }
+            if (record.kind >= FINDING_COUNT) record.operand = addString(message);
+            findings.push_back(record);
+        }
+    }
+    analysis.skipRecords = true;
+    analysis.field(const_cast<FileAnalysis&>(result));     // Writing never changes it
+
+    // Each section starts on an 8 byte boundary after the one before it
+    uint64_t offset = sizeof(IrHeader);
+    auto place = [&](uint64_t bytes) { uint64_t start = (offset + 7) & ~uint64_t(7); offset = start + bytes; return start; };
+    std::memcpy(header.magic, IR_MAGIC, sizeof(IR_MAGIC));
+    header.version = IR_VERSION;
+    header.byteOrder = IR_BYTE_ORDER;
+    header.isa = result.isa;
+    header.lineCount = lines.size();
+    header.instructionCount = instructions.size();
+    header.operandCount = operands.size();
+    header.labelCount = labels.size();
+    header.directiveCount = directives.size();
+    header.sourceFileCount = sourceFiles.size();
+    header.sourceMapCount = result.sourceMap.size();
+    header.findingCount = findings.size();
+    header.linesOffset = place(lines.size() * sizeof(IrString));
+    header.instructionsOffset = place(instructions.size() * sizeof(IrInstruction));
+    header.operandsOffset = place(operands.size() * sizeof(IrString));
+    header.labelsOffset = place(labels.size() * sizeof(IrLabel));
+    header.directivesOffset = place(directives.size() * sizeof(IrDirective));
+    header.sourceFilesOffset = place(sourceFiles.size() * sizeof(IrString));
+    header.sourceMapOffset = place(result.sourceMap.size() * sizeof(SourceLine));
+    header.findingsOffset = place(findings.size() * sizeof(IrFinding));
+    header.stringsOffset = place(strings.size());
+    header.stringsSize = strings.size();
+    header.textOffset = place(result.sourceText.size());
+    header.textSize = result.sourceText.size();
+    header.analysisOffset = place(analysis.bytes.size());
+    header.analysisSize = analysis.bytes.size();
+
+    std::ofstream out(output_file, std::ios::binary);
+    if (!out.is_open())
+    {
+        std::cerr << "Error: Failed to create file: " << output_file << "\n";
+        return false;
+    }
+    auto write = [&](uint64_t at, const void* bytes, size_t size)
+    {
+        static const char padding[8] = {};
+        out.write(padding, at - uint64_t(out.tellp()));
+        out.write(static_cast<const char*>(bytes), size);
+    };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write(header.linesOffset, lines.data(), lines.size() * sizeof(IrString));
+    write(header.instructionsOffset, instructions.data(), instructions.size() * sizeof(IrInstruction));
+    write(header.operandsOffset, operands.data(), operands.size() * sizeof(IrString));
+    write(header.labelsOffset, labels.data(), labels.size() * sizeof(IrLabel));
+    write(header.directivesOffset, directives.data(), directives.size() * sizeof(IrDirective));
+    write(header.sourceFilesOffset, sourceFiles.data(), sourceFiles.size() * sizeof(IrString));
+    write(header.sourceMapOffset, result.sourceMap.data(), result.sourceMap.size() * sizeof(SourceLine));
+    write(header.findingsOffset, findings.data(), findings.size() * sizeof(IrFinding));
+    write(header.stringsOffset, strings.data(), strings.size());
+    write(header.textOffset, result.sourceText.data(), result.sourceText.size());
+    write(header.analysisOffset, analysis.bytes.data(), analysis.bytes.size());
+
+    return bool(out);
+}
+
+/***************************************************************************
+ * openIr maps a binary IR file into memory. It checks the header, that
+ * every section is aligned and inside the file and that the records only
+ * point inside their sections, so the sections can be read without
+ * further checks. Returns false if the file isn't IR AEC can read. */
+bool openIr(const std::string& input_file, IrFile& ir) {
+    int fd = open(input_file.c_str(), O_RDONLY);
+    struct stat file_stat;
+
+    if (fd < 0) return false;
+    if (fstat(fd, &file_stat) != 0 || size_t(file_stat.st_size) < sizeof(IrHeader))
+    {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    ir.data = static_cast<const char*>(mapped);
+    ir.size = file_stat.st_size;
+    ir.header = ir.section<IrHeader>(0);
+
+    const IrHeader& h = *ir.header;
+    auto inside = [&](uint64_t offset, uint64_t bytes) { return offset % 8 == 0 && offset <= ir.size && bytes <= ir.size - offset; };
+    if (std::memcmp(h.magic, IR_MAGIC, sizeof(IR_MAGIC)) != 0 || h.version != IR_VERSION ||
+        h.byteOrder != IR_BYTE_ORDER || h.isa > ISA_AARCH64 ||
+        !inside(h.linesOffset, uint64_t(h.lineCount) * sizeof(IrString)) ||
+        !inside(h.instructionsOffset, uint64_t(h.instructionCount) * sizeof(IrInstruction)) ||
+        !inside(h.operandsOffset, uint64_t(h.operandCount) * sizeof(IrString)) ||
+        !inside(h.labelsOffset, uint64_t(h.labelCount) * sizeof(IrLabel)) ||
+        !inside(h.directivesOffset, uint64_t(h.directiveCount) * sizeof(IrDirective)) ||
+        !inside(h.sourceFilesOffset, uint64_t(h.sourceFileCount) * sizeof(IrString)) ||
+        !inside(h.sourceMapOffset, uint64_t(h.sourceMapCount) * sizeof(SourceLine)) ||
+        !inside(h.findingsOffset, uint64_t(h.findingCount) * sizeof(IrFinding)) ||
+        !inside(h.stringsOffset, h.stringsSize) || !inside(h.textOffset, h.textSize) ||
+        !inside(h.analysisOffset, h.analysisSize))
+    {
+        return false;
+    }
+
+    const IrInstruction* instructions = ir.section<IrInstruction>(h.instructionsOffset);
+    const IrLabel* labels = ir.section<IrLabel>(h.labelsOffset);
+    const SourceLine* map = ir.section<SourceLine>(h.sourceMapOffset);
+    const IrFinding* findings = ir.section<IrFinding>(h.findingsOffset);
+    for (uint32_t i = 0; i < h.instructionCount; i++)
+    {
+        if (instructions[i].firstOperand > h.operandCount || instructions[i].operandCount > h.operandCount - instructions[i].firstOperand ||
+            instructions[i].flow > FLOW_RETURN || instructions[i].mode >= MODE_COUNT)
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h.labelCount; i++)
+    {
+        if (labels[i].instruction > h.instructionCount) return false;
+    }
+    for (uint32_t i = 0; i < h.sourceMapCount; i++)
+    {
+        if (map[i].file < 0 || uint32_t(map[i].file) >= h.sourceFileCount) return false;
+    }
+    for (uint32_t i = 0; i < h.findingCount; i++)
+    {
+        if (findings[i].kind >= FINDING_COUNT + findingListCount) return false;
     }
+    return true;
+}
 
-    /*******************************************************************************
-     * A value that is defined would be used as an operand somewhere in the program.
-     * If the value is not in the list of unique operands then it was not used. */
-    for(size_t i = 0; i < labels.size(); i++)
+/***************************************************************************
+ * loadIr rebuilds the analysis of a file's lines from its binary IR, as
+ * analyzeLines would have left it, so finishAnalysis can run on it
+ * without the text being tokenized again. Returns false if the analysis
+ * section can't be read back. */
+bool loadIr(const IrFile& ir, FileAnalysis& result) {
+    const IrHeader& h = *ir.header;
+    const IrInstruction* instructions = ir.section<IrInstruction>(h.instructionsOffset);
+    const IrString* operands = ir.section<IrString>(h.operandsOffset);
+    const IrLabel* labels = ir.section<IrLabel>(h.labelsOffset);
+    const IrDirective* directives = ir.section<IrDirective>(h.directivesOffset);
+    const IrString* names = ir.section<IrString>(h.sourceFilesOffset);
+    const SourceLine* map = ir.section<SourceLine>(h.sourceMapOffset);
+    const IrFinding* findings = ir.section<IrFinding>(h.findingsOffset);
+    AnalysisArchive analysis;
+
+    analysis.bytes.assign(ir.data + h.analysisOffset, h.analysisSize);
+    analysis.reading = true;
+    analysis.skipRecords = true;
+    analysis.field(result);
+    if (analysis.failed || analysis.pos != analysis.bytes.size() || result.registerUse.size() != 32 ||
+        result.model.registerCount < 0 || result.model.registerCount > 32 || result.badBranchTarget.size() != result.badBranchLineNum.size())
     {
-        if(uniqueOperands.find(labels[i]) == uniqueOperands.end())
-        {
-            unusedLabel.push_back("Unused label: " + labels[i]);
-        }
+        return false;
     }
-    for(size_t i = 0; i < variables.size(); i++)
+    result.isa = IsaProfile(h.isa);
+
+    result.code.reserve(h.instructionCount);
+    for (uint32_t i = 0; i < h.instructionCount; i++)
     {
-        if(uniqueOperands.find(variables[i]) == uniqueOperands.end())
-        {
-            unusedVariable.push_back("Unused user variable: " + variables[i]);
-        }
+        const IrInstruction& record = instructions[i];
+        Instruction instruction;
+        instruction.line = record.line;
+        instruction.op = ir.text(record.op);
+        for (uint32_t j = 0; j < record.operandCount; j++) instruction.operands.push_back(ir.text(operands[record.firstOperand + j]));
+        instruction.useMask = record.useMask;
+        instruction.argumentMask = record.argumentMask;
+        instruction.defMask = record.defMask;
+        instruction.clobberMask = record.clobberMask;
+        instruction.stackDelta = record.stackDelta;
+        instruction.flow = Flow(record.flow);
+        instruction.conditional = record.conditional;
+        instruction.restore = record.restore;
+        instruction.call = record.call;
+        instruction.mode = AddressMode(record.mode);
+        instruction.target = ir.text(record.target);
+        result.code.push_back(std::move(instruction));
+    }
+    for (uint32_t i = 0; i < h.labelCount; i++)
+    {
+        std::string name = ir.text(labels[i].name);
+        result.labels.push_back(name);
+        result.labelLineNum.push_back(labels[i].line);
+        result.labelIndex[name] = labels[i].instruction;
     }
-    for(size_t i = 0; i < constants.size(); i++)
+    for (uint32_t i = 0; i < h.directiveCount; i++) result.directiveUse[ir.text(directives[i].name)].push_back(directives[i].line);
+    for (uint32_t i = 0; i < h.sourceFileCount; i++) result.sourceFiles.push_back(ir.text(names[i]));
+    result.sourceMap.assign(map, map + h.sourceMapCount);
+    for (uint32_t i = 0; i < h.findingCount; i++)
     {
-        if(uniqueOperands.find(constants[i]) == uniqueOperands.end())
+        const IrFinding& record = findings[i];
+        if (record.kind < FINDING_COUNT)
+        {
+            (result.*findingFormats[record.kind].list).push_back(findingText(Finding(record.kind), ir.text(record.operand), int(record.line)));
+        }
+        else
         {
-            unusedConstant.push_back("Unused user constant: " + constants[i]);
+            (result.*findingLists[record.kind - FINDING_COUNT]).push_back(ir.text(record.operand));
         }
     }
+    return true;
+}
 
-    /*****************************************************************************
-     * Label analyzer, it first defines what kind of label is being checked first
-     * then reads in line numbers of various flags to determine what happens 
-     * within said label to determine errors. It works because label and
-     * labelLineNum are correlated positionally. */
-    for(size_t i = 0; i < labels.size(); i++)
+/***************************************************************************
+ * lspServer runs AEC as a language server over stdin and stdout. Open
+ * documents are kept in memory and changed by the edits the editor sends,
+ * which are ranges of lines, not whole files. Edits are only analyzed
+ * once no more messages are waiting, so a burst of keystrokes costs one
+ * analysis. Returns the exit code the protocol asks for. */
+int lspServer(AnalysisOptions options) {
+    std::unordered_map<std::string, LspDocument> documents;
+    std::string body;
+    bool shutdown = false;
+
+    options.outputs = OUTPUT_DIAGNOSTICS;
+    options.includes = nullptr;     // Included files may be edited too, so they are read each time
+
+    while (readLspMessage(body))
     {
-        subroutineFlag = false;
-        returnFlag = false;
-        subroutineCall = false;
-        lrSaved = false;
+        JsonValue message;
+        size_t pos = 0;
+        if (!parseJson(body, pos, message) || message.type != JsonValue::JSON_OBJECT) continue;
 
-        // Declare whether the current label is a subroutine
-        if(subroutines.find(labels[i]) != subroutines.end()) subroutineFlag = true;
+        const std::string& method = message["method"].text;
+        const JsonValue& id = message["id"];
+        const JsonValue& params = message["params"];
+        const std::string& uri = params["textDocument"]["uri"].text;
 
-        if(subroutineFlag == true)  
+        if (method == "initialize")
         {
-            // The last label will have nothing to compare to, so we use .data instead
-            if(i + 1 != labels.size())
-            {
-                nextLabel = labelLineNum[i+1];
-            }
-            else if(i + 1 == labels.size())
-            {
-                nextLabel = dataLineNum;
-            }
-            // If the label is a subroutine, check that it has a return before the label ends
-            for (size_t j = 0; j < returnLineNum.size(); j++)
-            {
-                // If any of the returns happen between when the label starts and ends
-                if(returnLineNum[j] >= labelLineNum[i] && returnLineNum[j] < nextLabel)
-                {
-                    returnFlag = true;
-                }
-            }
-            // Check if a call to a subroutine is made inside the subroutine
-            for (size_t j = 0; j < blCallLineNum.size(); j++)
-            {   // If any of the subroutine calls happen between label start and end
-                if(blCallLineNum[j] >= labelLineNum[i] && blCallLineNum[j] < nextLabel)
-                {
-                    subroutineCall = true;
-                    for(size_t k = 0; k < lrSaveLineNum.size(); k++)
-                    {   // If the LR was saved in a label where a subroutine was called after the label line
-                        // number but before the subroutine call line number
-                        if(lrSaveLineNum[k] >= labelLineNum[i] && lrSaveLineNum[k] <= blCallLineNum[j])
-                        {
-                            lrSaved = true;
-                        }
-                    }
-                }
-            }
-            // Check if  subroutine branches outside of its bounds
-            for (size_t j = 0; j < badBranchLineNum.size(); j++)
-            {
-                // If any of the returns happen between when the label starts and ends
-                if(badBranchLineNum[j] >= labelLineNum[i] && badBranchLineNum[j] < nextLabel)
+            writeLspMessage("{\"jsonrpc\":\"2.0\",\"id\":" + jsonId(id) + ",\"result\":{\"capabilities\":"
+                "{\"textDocumentSync\":{\"openClose\":true,\"change\":2}},\"serverInfo\":{\"name\":\"AEC\",\"version\":\"1.0\"}}}");
+        }
+        else if (method == "shutdown")
+        {
+            shutdown = true;
+            writeLspMessage("{\"jsonrpc\":\"2.0\",\"id\":" + jsonId(id) + ",\"result\":null}");
+        }
+        else if (method == "exit")
+        {
+            return shutdown ? 0 : 1;
+        }
+        else if (method == "textDocument/didOpen")
+        {
+            LspDocument& document = documents[uri];
+            document = LspDocument();
+            document.path = uri.rfind("file://", 0) == 0 ? uri.substr(7) : uri;
+            for (size_t i = 0; i + 2 < document.path.size(); i++)
+            {   // Percent escapes, like %20 for a space
+                if (document.path[i] == '%' && std::isxdigit(static_cast<unsigned char>(document.path[i + 1])) &&
+                    std::isxdigit(static_cast<unsigned char>(document.path[i + 2])))
                 {
-                    branchOutError.push_back(labels[i] + " branches out of the subroutine bounds at line " + 
-                    std::to_string(badBranchLineNum[j]));
+                    document.path.replace(i, 3, 1, char(std::stoi(document.path.substr(i + 1, 2), nullptr, 16)));
                 }
             }
+            JsonValue whole;
+            whole.type = JsonValue::JSON_OBJECT;
+            whole.members.push_back({"text", params["textDocument"]["text"]});
+            applyLspChange(document, whole);
         }
-        // If there is a subroutine but not a return
-        if(subroutineFlag == true && returnFlag == false)
+        else if (method == "textDocument/didChange" && documents.count(uri))
         {
-            noReturnError.push_back(labels[i] + " has no return despite being a subroutine.");
+            for (auto& change : params["contentChanges"].items) applyLspChange(documents[uri], change);
         }
-        // If there is a subroutine but not a saved spot
-        if(subroutineCall == true && lrSaved == false)
+        else if (method == "textDocument/didClose")
+        {
+            documents.erase(uri);
+            writeLspMessage("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":\"" +
+                jsonEscape(uri) + "\",\"diagnostics\":[]}}");
+        }
+        else if (id.type != JsonValue::JSON_NULL)
+        {
+            writeLspMessage("{\"jsonrpc\":\"2.0\",\"id\":" + jsonId(id) + ",\"error\":{\"code\":-32601,\"message\":\"Method not found\"}}");
+        }
+
+        // Analyze only when the editor has nothing more to send
+        pollfd input = {0, POLLIN, 0};
+        if (poll(&input, 1, 0) > 0) continue;
+        for (auto& document : documents)
         {
-            lrSaveError.push_back(labels[i] + " has a call to a subroutine in it without saving the LR first.");
+            if (document.second.dirty) publishDiagnostics(document.first, document.second, options);
         }
     }
+    return shutdown ? 0 : 1;
+}
 
-    // This section is where you add logic to determine or calculate metrics/errors
-    // Halstead's
-    int length = totalOperators + totalOperands; 
-    int vocabulary = uniqueOperators.size() + uniqueOperands.size();
-    double volume = length * log2(vocabulary);
-    double difficulty = (double(uniqueOperators.size()) / 2.0) * (double(totalOperands) / double(uniqueOperands.size())); 
-    double effort = difficulty * volume; 
-
-    /***********************************************
-     * Meta data        */
-    std::string TOOL_VERSION = "1.0";
-    std::string TOOL_DATE = "4/27/2024";
-    struct stat file_stat;
-    std::time_t access_time;
-    std::time_t mod_time;
+/***************************************************************************
+ * readLspMessage reads one message body, after its Content-Length header.
+ * stdin is read with read so poll sees what is still waiting. */
+bool readLspMessage(std::string& body) {
+    static std::string buffer;
+    size_t length = 0, end;
+    char chunk[65536];
 
-    stat(input_file.c_str(), &file_stat);
-    access_time = file_stat.st_atime;
-    mod_time = file_stat.st_mtime;
+    while ((end = buffer.find("\r\n\r\n")) == std::string::npos)
+    {
+        ssize_t got = read(0, chunk, sizeof(chunk));
+        if (got <= 0) return false;
+        buffer.append(chunk, got);
+    }
+    size_t header = buffer.find("Content-Length:");
+    if (header != std::string::npos && header < end) length = std::strtoul(buffer.c_str() + header + 15, nullptr, 10);
+    buffer.erase(0, end + 4);
 
-    namespace fs = std::filesystem;
-    fs::path filePath(input_file);
-    std::string fileName = filePath.filename().string();
+    while (buffer.size() < length)
+    {
+        ssize_t got = read(0, chunk, sizeof(chunk));
+        if (got <= 0) return false;
+        buffer.append(chunk, got);
+    }
+    body = buffer.substr(0, length);
+    buffer.erase(0, length);
+    return true;
+}
 
+void writeLspMessage(const std::string& body) {
+    std::cout << "Content-Length: " << body.size() << "\r\n\r\n" << body << std::flush;
+}
 
-    // Case 1 = Metrics to terminal, Case 2 = Errors to terminal
-    // Case 3 = Make report file
-    switch(command) 
+/***************************************************************************
+ * applyLspChange applies one content change of the editor. A change with
+ * no range is the whole text. Characters are counted as bytes, which is
+ * what the editor counts for the ASCII of assembly files. */
+void applyLspChange(LspDocument& document, const JsonValue& change) {
+    std::vector<std::string> pieces(1);
+    for (char c : change["text"].text)
     {
-        case 4:
-            /**********************************************************************************
-             * If the csv file doesn't exist, create the header row, otherwise
-             * we just want to append new data 
-             * Have to use put_time and local time to avoid ctimes newline character ending*/
-            if(!std::filesystem::exists(output_file))
-            {
-                std::ofstream writecsv(output_file, std::ios::app);
-                writecsv << "File name, Last Accessed, Last Modified, Halstead's Total Operators,"
-                            << " Total Operands, Unique Operators, Unique Operands, Length, Vocabulary, Volume, Difficulty,"
-                            << " Effort\n";
-                writecsv << fileName << ", " << std::put_time(std::localtime(&access_time), "%c") << ", "
-                << std::put_time(std::localtime(&mod_time), "%c") << ", " << totalOperators << ", " << totalOperands 
-                << ", " << uniqueOperators.size() << ", " << uniqueOperands.size() << ", " << length << ", " << vocabulary 
-                << ", " << volume << ", " << difficulty << ", " << effort << "\n";
-            }
-            else
-            {
-                std::ofstream writecsv(output_file, std::ios::app);
-                writecsv << fileName << ", " << std::put_time(std::localtime(&access_time), "%c") << ", "
-                << std::put_time(std::localtime(&mod_time), "%c") << ", " << totalOperators << ", " << totalOperands 
-                << ", " << uniqueOperators.size() << ", " << uniqueOperands.size() << ", " << length << ", " << vocabulary 
-                << ", " << volume << ", " << difficulty << ", " << effort << "\n";
-            }
-            break;
+        if (c == '\n') pieces.emplace_back();
+        else if (c != '\r') pieces.back() += c;
+    }
 
-        case 1:
-            std::cout << "********************************************************\nMetadata:\n";
-            std::cout << "\tFile Name: " << fileName << "\n";
-            std::cout << "\tLast accessed: " << std::ctime(&access_time);
-            std::cout << "\tLast modified: " << std::ctime(&mod_time);
-            std::cout << "\tTool Version: " << TOOL_VERSION << "\n";
-            std::cout << "\tTool Date: " << TOOL_DATE << "\n";
-            std::cout << "********************************************************\nGeneral Metrics:\n";
-            std::cout << "\tNumber of full line comments: " << fullCommentLines << "\n";
-            std::cout << "\tNumber of blank lines: " << blankLines << "\n";
-            std::cout << "\tTotal number of lines: " << totalLines << "\n";
-            std::cout << "\tNumber of lines with comments: " << linesWComment << "\n";
-            std::cout << "\tNumber of lines without comments: " << linesWOComment << "\n";
-            std::cout << "\tTotal directives used: " << dirLines << "\n";
-            std::cout << "\tCyclomatic Complexity: " << cyclomatic << "\n";
-            std::cout << "********************************************************\n";
-            std::cout << "Halstead's Metrics:\n";
-            std::cout << "\tUnique operators: " << uniqueOperators.size() << "\n";
-            std::cout << "\tTotal operators: " << totalOperators << "\n";
-            std::cout << "\tUnique operands: " << uniqueOperands.size() << "\n";
-            std::cout << "\tTotal operands: " << totalOperands << "\n";
-            std::cout << "\tProgram Length: " << length << "\n";
-            std::cout << "\tProgram Vocabulary: " << vocabulary << "\n";
-            std::cout << "\tProgram Volume: " << volume << "\n";
-            std::cout << "\tProgram Difficulty: " << difficulty << "\n";
-            std::cout << "\tProgram Effort: " << effort << "\n";
-            std::cout << "********************************************************\n";
-            std::cout << "Register Use:\n";
-            std::cout << "\tRegister 0 used at lines: ";
-            sorter.assign(register0Use.begin(), register0Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 1 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register1Use.begin(), register1Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 2 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register2Use.begin(), register2Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 3 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register3Use.begin(), register3Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 4 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register4Use.begin(), register4Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 5 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register5Use.begin(), register5Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 6 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register6Use.begin(), register6Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 7 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register7Use.begin(), register7Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 8 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register8Use.begin(), register8Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 9 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register9Use.begin(), register9Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 10 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register10Use.begin(), register10Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 11 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register11Use.begin(), register11Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 12 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register12Use.begin(), register12Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 13 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register13Use.begin(), register13Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 14 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register14Use.begin(), register14Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tRegister 15 used at lines: ";
-            sorter.clear();     // Sorter ready for reuse
-            sorter.assign(register15Use.begin(), register15Use.end());
-            std::sort(sorter.begin(), sorter.end());    // Sort register use
-            for(auto& line : sorter)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n********************************************************\n";
-            std::cout << "SVC Use:\n";
-            for(auto& line : svcUse)
-            {
-                std::cout << "\t" << line << "\n";
-            }
-            std::cout << "Subroutine Use:\n";
-            for(auto& line : subroutineUse)
-            {
-                std::cout << "\t" << line << "\n";
-            }
-            std::cout << "Branch Use:\n";
-            for(auto& line : branchUse)
-            {
-                std::cout << "\t" << line << "\n";
-            }
-            std::cout << "Directive Use:\n";
-            for (auto& map : directiveUse) 
-            {
-                std::cout << "\t" << map.first << " at lines: ";
-                for (size_t i = 0; i < map.second.size(); i++) 
-                {
-                    std::cout << map.second[i] << " ";
-                }
-                std::cout << "\n";
-            }
-            std::cout << "********************************************************\n";
-            std::cout << "Addressing Modes:\n";
-            std::cout << "\tLines with indirect addressing: ";
-            for(auto& line : indirectMode)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tLines with indirect addressing with offset: ";
-            for(auto& line : indirectOffsetMode)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tLines with auto, pre-index addressing: ";
-            for(auto& line : preIndexMode)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tLines with auto, post-index addressing: ";
-            for(auto& line : postIndexMode)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tLines with PC relative addressing: ";
-            for(auto& line : pcRelativeMode)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tLines with PC relative addressing with literal pool: ";
-            for(auto& line : pcLiteralMode)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n\tLines with uncertain addressing modes: ";
-            for(auto& line : unsureMode)
-            {
-                std::cout << line << " ";
-            }
-            std::cout << "\n********************************************************\n";
-            break;
+    const JsonValue& range = change["range"];
+    size_t first = 0, last = document.lines.size() - 1, from = 0, to = document.lines[last].size();
+    if (range.type == JsonValue::JSON_OBJECT)
+    {
+        first = std::min<size_t>(range["start"]["line"].number, document.lines.size() - 1);
+        last = std::min<size_t>(range["end"]["line"].number, document.lines.size() - 1);
+        from = std::min<size_t>(range["start"]["character"].number, document.lines[first].size());
+        to = std::min<size_t>(range["end"]["character"].number, document.lines[last].size());
+        if (last < first) last = first;
+    }
 
-        case 2:
-            if (dataExists == false)
-            {
-                std::cout << fileName << ": Catastrophic error: Missing .data section. Error must be addressed before using AEC" << "\n";
-            }
-            else if (globalErrorFlag == true)
-            {
-                std::cout << fileName << ": Catastrophic error: .data section comes before .global. Error must be addressed before using AEC" << "\n";
-            }
-            else
-            {
-                std::cout << "********************************************************\nMetadata:\n";
-                std::cout << "\tFile Name: " << fileName << "\n";
-                std::cout << "\tLast accessed: " << std::ctime(&access_time);
-                std::cout << "\tLast modified: " << std::ctime(&mod_time);
-                std::cout << "\tTool Version: " << TOOL_VERSION << "\n";
-                std::cout << "\tTool Date: " << TOOL_DATE << "\n";
-                std::cout << "********************************************************\nErrors found:\n";
-            
-                if (exitExists == false)
-                {
-                    std::cout << "\tNo proper exit, svc 0, from program before .data section\n";
-                }
-                if(pushNum > popNum)
-                {
-                    std::cout << "\tMore pushes detected than pops. Ensure that all values are popped off the heap.\n";
-                }
-                else if(pushNum < popNum)
-                {
-                    std::cout << "\tMore pops detected than pushes. Ensure that there is always a value on the heap before a Pop.\n";
-                }
+    pieces.front() = document.lines[first].substr(0, from) + pieces.front();
+    pieces.back() += document.lines[last].substr(to);
+    document.lines.erase(document.lines.begin() + first, document.lines.begin() + last + 1);
+    document.lines.insert(document.lines.begin() + first, pieces.begin(), pieces.end());
+    document.dirty = true;
+}
 
-                for(auto& line : stringError)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : unwantedInstructions)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : restrictedError)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : unusedConditional)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : unusedLabel)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : unusedVariable)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : unusedConstant)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : isolatedCode)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : noReturnError)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : lrSaveError)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : branchOutError)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                for(auto& line : registerError)
-                {
-                    std::cout << "\t" << line << "\n";
-                }
-                std::cout << "********************************************************\n";
-            
-            }
-            break;
+/***************************************************************************
+ * definitionLines finds the line, from 1, each label, variable and
+ * constant of a file is defined at, from the lines the analysis kept for
+ * them. Expanded lines are where they came from in the file itself. The
+ * first definition is kept. */
+std::unordered_map<std::string, int> definitionLines(const FileAnalysis& result) {
+    std::unordered_map<std::string, int> definitions;
+    const std::pair<const std::vector<std::string>*, const std::vector<int>*> lists[] = {
+        {&result.streamedLabels, &result.streamedLabelLineNum}, {&result.labels, &result.labelLineNum},
+        {&result.variables, &result.variableLineNum}, {&result.constants, &result.constantLineNum}};
+    for (auto& list : lists)
+    {
+        for (size_t i = 0; i < list.first->size() && i < list.second->size(); i++)
+        {
+            int line = (*list.second)[i];
+            if (line >= 1 && line <= (int)result.sourceMap.size()) line = result.sourceMap[line - 1].site;
+            definitions.insert({(*list.first)[i], line});
+        }
+    }
+    return definitions;
+}
+
+/***************************************************************************
+ * definitionLine finds the line, from 1, an error without a line is
+ * about. The label or value is the last word after a colon or the first
+ * word. Returns 0 if neither is defined in definitions. */
+int definitionLine(const std::string& message, const std::unordered_map<std::string, int>& definitions) {
+    size_t colon = message.find(": ");
+    std::string names[2] = {message.substr(colon == std::string::npos ? message.size() : colon + 2), message.substr(0, message.find(' '))};
+    for (auto& name : names)
+    {
+        auto definition = definitions.find(name);
+        if (definition != definitions.end()) return definition->second;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ * publishDiagnostics analyzes a document and sends its errors. Errors
+ * name their line, or the label or value they are about, which is looked
+ * up where the analysis found it. Errors with neither go on the first line. */
+void publishDiagnostics(const std::string& uri, LspDocument& document, const AnalysisOptions& options) {
+    FileAnalysis result;
+    std::string contents, diagnostics;
+    std::vector<std::pair<std::string, std::string>> errors;     // Rule and message
+    std::unordered_map<std::string, int> definitions;           // Labels and values to the line they are defined at
+
+    for (auto& line : document.lines) contents += line + "\n";
+    document.dirty = false;
+
+    analyzeIncremental(document.path, contents, document.cache, result, options);
+    if (result.dataExists == false || result.globalErrorFlag == true)
+    {
+        errors.push_back({"catastrophic", result.dataExists == false ? "Catastrophic error: Missing .data section" :
+            "Catastrophic error: .data section comes before .global"});
+    }
+    else
+    {
+        finishAnalysis(result, nullptr);
+        forEachError(result, [&](int rule, const std::string& message) { errors.push_back({ruleNames[rule], message}); });
+    }
+
+    for (auto& error : errors)
+    {
+        const std::string& message = error.second;
+        size_t line = std::max(errorLine(message), 1) - 1;
+        if (message.find("line ") == std::string::npos)
+        {
+            // Where each label and value is defined is found once for all the errors
+            if (definitions.empty()) definitions = definitionLines(result);
+            int defined = definitionLine(message, definitions);
+            if (line == 0 && defined > 0) line = defined - 1;
+        }
+        if (line >= document.lines.size()) line = 0;
 
-        case 3:
-            if (dataExists == false)
-            {
-                std::cout << fileName << ": Catastrophic error: Missing .data section. Error must be addressed before using AEC" << "\n";
-            }
-            else if (globalErrorFlag == true)
+        if (!diagnostics.empty()) diagnostics += ",";
+        diagnostics += "{\"range\":{\"start\":{\"line\":" + std::to_string(line) + ",\"character\":0},\"end\":{\"line\":" +
+            std::to_string(line) + ",\"character\":" + std::to_string(document.lines[line].size()) + "}},\"severity\":2," +
+            "\"source\":\"AEC\",\"code\":\"" + jsonEscape(error.first) + "\",\"message\":\"" + jsonEscape(message) + "\"}";
+    }
+
+    writeLspMessage("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":\"" +
+        jsonEscape(uri) + "\",\"diagnostics\":[" + diagnostics + "]}}");
+}
+
+/***************************************************************************
+ * parseJson parses the value starting at pos and moves pos past it.
+ * Returns false if the text is not JSON. */
+bool parseJson(const std::string& text, size_t& pos, JsonValue& value) {
+    auto space = [&]() { while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) pos++; };
+    // Four hex digits of a \u escape start at
+    auto hex = [&](size_t at) { return at + 4 <= text.size() &&
+        std::all_of(text.begin() + at, text.begin() + at + 4, [](char c) { return std::isxdigit(static_cast<unsigned char>(c)) != 0; }); };
+    auto word = [&](const char* expected) {
+        size_t length = std::strlen(expected);
+        if (text.compare(pos, length, expected) != 0) return false;
+        pos += length;
+        return true;
+    };
+
+    space();
+    if (pos >= text.size()) return false;
+    char c = text[pos];
+
+    if (c == '{' || c == '[')
+    {
+        value.type = c == '{' ? JsonValue::JSON_OBJECT : JsonValue::JSON_ARRAY;
+        pos++;
+        space();
+        if (pos < text.size() && text[pos] == (c == '{' ? '}' : ']'))
+        {
+            pos++;
+            return true;
+        }
+        while (true)
+        {
+            JsonValue key, item;
+            if (c == '{')
             {
-                std::cout << fileName << ": Catastrophic error: .data section comes before .global. Error must be addressed before using AEC" << "\n";
+                if (!parseJson(text, pos, key) || key.type != JsonValue::JSON_STRING) return false;
+                space();
+                if (pos >= text.size() || text[pos++] != ':') return false;
             }
-            else
+            if (!parseJson(text, pos, item)) return false;
+            if (c == '{') value.members.push_back({key.text, std::move(item)});
+            else value.items.push_back(std::move(item));
+            space();
+            if (pos >= text.size()) return false;
+            if (text[pos] == ',') { pos++; continue; }
+            return text[pos++] == (c == '{' ? '}' : ']');
+        }
+    }
+    if (c == '"')
+    {
+        value.type = JsonValue::JSON_STRING;
+        for (pos++; pos < text.size() && text[pos] != '"'; pos++)
+        {
+            if (text[pos] != '\\') { value.text += text[pos]; continue; }
+            if (++pos >= text.size()) return false;
+            switch (text[pos])
             {
-                std::ofstream outfile(output_file);
-                outfile << "********************************************************\nMetadata:\n";
-                outfile << "\tFile Name: " << fileName << "\n";
-                outfile << "\tLast accessed: " << std::ctime(&access_time);
-                outfile << "\tLast modified: " << std::ctime(&mod_time);
-                outfile << "\tTool Version: " << TOOL_VERSION << "\n";
-                outfile << "\tTool Date: " << TOOL_DATE << "\n";
-                outfile << "********************************************************\nGeneral Metrics:\n";
-                outfile << "\tNumber of full line comments: " << fullCommentLines << "\n";
-                outfile << "\tNumber of blank lines: " << blankLines << "\n";
-                outfile << "\tTotal number of lines: " << totalLines << "\n";
-                outfile << "\tNumber of lines with comments: " << linesWComment << "\n";
-                outfile << "\tNumber of lines without comments: " << linesWOComment << "\n";
-                outfile << "\tTotal directives used: " << dirLines << "\n";
-                outfile << "\tCyclomatic Complexity: " << cyclomatic << "\n";
-                outfile << "********************************************************\n";
-                outfile << "Halstead's Metrics:\n";
-                outfile << "\tUnique operators: " << uniqueOperators.size() << "\n";
-                outfile << "\tTotal operators: " << totalOperators << "\n";
-                outfile << "\tUnique operands: " << uniqueOperands.size() << "\n";
-                outfile << "\tTotal operands: " << totalOperands << "\n";
-                outfile << "\tProgram Length: " << length << "\n";
-                outfile << "\tProgram Vocabulary: " << vocabulary << "\n";
-                outfile << "\tProgram Volume: " << volume << "\n";
-                outfile << "\tProgram Difficulty: " << difficulty << "\n";
-                outfile << "\tProgram Effort: " << effort << "\n";
-                outfile << "********************************************************\n";
-                outfile << "Register Use:\n";
-                outfile << "\tRegister 0 used at lines: ";
-                sorter.assign(register0Use.begin(), register0Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 1 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register1Use.begin(), register1Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 2 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register2Use.begin(), register2Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 3 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register3Use.begin(), register3Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 4 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register4Use.begin(), register4Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 5 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register5Use.begin(), register5Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 6 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register6Use.begin(), register6Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 7 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register7Use.begin(), register7Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 8 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register8Use.begin(), register8Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 9 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register9Use.begin(), register9Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 10 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register10Use.begin(), register10Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 11 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register11Use.begin(), register11Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 12 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register12Use.begin(), register12Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 13 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register13Use.begin(), register13Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 14 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register14Use.begin(), register14Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tRegister 15 used at lines: ";
-                sorter.clear();     // Sorter ready for reuse
-                sorter.assign(register15Use.begin(), register15Use.end());
-                std::sort(sorter.begin(), sorter.end());    // Sort register use
-                for(auto& line : sorter)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n********************************************************\n";
-                outfile << "SVC Use:\n";
-                for(auto& line : svcUse)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                outfile << "Subroutine Use:\n";
-                for(auto& line : subroutineUse)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                outfile << "Branch Use:\n";
-                for(auto& line : branchUse)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                outfile << "Directive Use:\n";
-                for (auto& map : directiveUse) 
+                case 'n': value.text += '\n'; break;
+                case 't': value.text += '\t'; break;
+                case 'r': value.text += '\r'; break;
+                case 'b': value.text += '\b'; break;
+                case 'f': value.text += '\f'; break;
+                case 'u':
                 {
-                    outfile << "\t" << map.first << " at lines: ";
-                    for (size_t i = 0; i < map.second.size(); i++) 
-                    {
-                        outfile << map.second[i] << " ";
+                    if (!hex(pos + 1)) return false;
+                    unsigned code = std::stoul(text.substr(pos + 1, 4), nullptr, 16);
+                    pos += 4;
+                    if (code >= 0xD800 && code < 0xDC00 && text.compare(pos + 1, 2, "\\u") == 0 && hex(pos + 3))
+                    {   // Surrogate pair
+                        code = 0x10000 + ((code - 0xD800) << 10) + (std::stoul(text.substr(pos + 3, 4), nullptr, 16) - 0xDC00);
+                        pos += 6;
                     }
-                    outfile << "\n";
-                }
-                outfile << "********************************************************\n";
-                outfile << "Addressing Modes:\n";
-                outfile << "\tLines with indirect addressing: ";
-                for(auto& line : indirectMode)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tLines with indirect addressing with offset: ";
-                for(auto& line : indirectOffsetMode)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tLines with auto, pre-index addressing: ";
-                for(auto& line : preIndexMode)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tLines with auto, post-index addressing: ";
-                for(auto& line : postIndexMode)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tLines with PC relative addressing: ";
-                for(auto& line : pcRelativeMode)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tLines with PC relative addressing with literal pool: ";
-                for(auto& line : pcLiteralMode)
-                {
-                    outfile << line << " ";
-                }
-                outfile << "\n\tLines with uncertain addressing modes: ";
-                for(auto& line : unsureMode)
-                {
-                    outfile << line << " ";
+                    if (code < 0x80) value.text += char(code);
+                    else if (code < 0x800) value.text += {char(0xC0 | code >> 6), char(0x80 | (code & 0x3F))};
+                    else if (code < 0x10000) value.text += {char(0xE0 | code >> 12), char(0x80 | (code >> 6 & 0x3F)), char(0x80 | (code & 0x3F))};
+                    else value.text += {char(0xF0 | code >> 18), char(0x80 | (code >> 12 & 0x3F)), char(0x80 | (code >> 6 & 0x3F)), char(0x80 | (code & 0x3F))};
+                    break;
                 }
-                outfile << "\n********************************************************\n";
+                default: value.text += text[pos]; break;
+            }
+        }
+        return pos++ < text.size();
+    }
+    if (word("true") || word("false"))
+    {
+        value.type = JsonValue::JSON_BOOL;
+        value.boolean = text[pos - 2] == 'u';
+        return true;
+    }
+    if (word("null")) return true;
 
-                outfile << "Errors found:\n";
+    char* stop;
+    value.type = JsonValue::JSON_NUMBER;
+    value.number = std::strtod(text.c_str() + pos, &stop);
+    if (stop == text.c_str() + pos) return false;
+    pos = stop - text.c_str();
+    return true;
+}
 
-                if (exitExists == false)
-                {
-                    outfile << "\tNo proper exit, svc 0, from program before .data section\n";
-                }
+/***************************************************************************
+ * jsonEscape escapes text for a JSON string. */
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    char code[8];
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\') escaped += {'\\', c};
+        else if (c == '\n') escaped += "\\n";
+        else if (c == '\t') escaped += "\\t";
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else escaped += c;
+    }
+    return escaped;
+}
 
-                if(pushNum > popNum)
-                {
-                    outfile << "\tMore pushes detected than pops. Ensure that all values are popped off the heap.\n";
-                }
-                else if(pushNum < popNum)
-                {
-                    outfile << "\tMore pops detected than pushes. Ensure that there is always a value on the heap before a Pop.\n";
-                }
+/***************************************************************************
+ * jsonId writes a request id back the way it was sent. */
+std::string jsonId(const JsonValue& id) {
+    if (id.type == JsonValue::JSON_STRING) return "\"" + jsonEscape(id.text) + "\"";
+    if (id.type == JsonValue::JSON_NUMBER) return std::to_string((long long)id.number);
+    return "null";
+}
 
-                for(auto& line : stringError)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : unwantedInstructions)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : restrictedError)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : unusedConditional)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : unusedLabel)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : unusedVariable)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : unusedConstant)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : isolatedCode)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : noReturnError)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : lrSaveError)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : branchOutError)
-                {
-                    outfile << "\t" << line << "\n";
-                }
-                for(auto& line : registerError)
+/***************************************************************************
+ * The C interface of AEC.h. A result keeps the strings and arrays its
+ * fields point to, so the caller frees everything with one aec_free. */
+struct AecResult : aec_result
+{
+    std::string text;
+    std::vector<std::string> messages;
+    std::vector<aec_error> list;
+    double values[AEC_METRIC_COUNT] = {};
+    std::vector<std::vector<int>> lines;
+    std::vector<const int*> linePointers;
+    std::vector<size_t> lineCounts;
+    std::vector<std::string> names;
+    std::vector<aec_function> functionList;
+
+    AecResult() : aec_result() { metric_values = values; }
+};
+
+struct AecBatch : aec_batch
+{
+    std::vector<aec_result*> list;
+    std::vector<double> values;
+};
+
+/***************************************************************************
+ * Turns the options of a call into analysis options. Returns a failed
+ * result if the rules file is bad, nullptr otherwise. */
+AecResult* aecOptions(const aec_options* given, AnalysisOptions& options) {
+    std::ostringstream log;
+
+    if (given != nullptr && given->isa >= AEC_ISA_DETECT && given->isa <= AEC_ISA_AARCH64) options.isa = IsaProfile(given->isa);
+    if (given != nullptr && given->rules_file != nullptr && !loadRules(given->rules_file, options.rules, log))
+    {
+        AecResult* out = new AecResult();
+        out->status = AEC_FAILED;
+        out->text = log.str();
+        out->message = out->text.c_str();
+        return out;
+    }
+    compileOperators(options.rules);
+    return nullptr;
+}
+
+/***************************************************************************
+ * aecResult analyzes the text of one file into a new result. What the
+ * preprocessor reports is kept as the result's message. */
+AecResult* aecResult(const std::string& fileName, const std::string& contents, const AnalysisOptions& shared) {
+    AecResult* out = new AecResult();
+    FileAnalysis gate, result;
+    AnalysisOptions options = shared;
+    std::ostringstream log;
+    options.log = &log;
+
+    out->status = AEC_OK;
+
+    // Same gate as the reports, a catastrophic error stops the analysis
+    if (precheckFile(fileName, gate, &contents) && (gate.dataExists == false || gate.globalErrorFlag == true))
+    {
+        out->status = AEC_CATASTROPHIC;
+        out->text = gate.dataExists == false ? "Missing .data section" : ".data section comes before .global";
+        out->message = out->text.c_str();
+        return out;
+    }
+    analyzeFile(fileName, result, options, &contents);
+    finishAnalysis(result, nullptr);
+    out->text = log.str();
+    if (!out->text.empty()) out->message = out->text.c_str();
+
+    aec_metrics& m = out->metrics;
+    m.total_lines = result.totalLines;
+    m.blank_lines = result.blankLines;
+    m.comment_lines = result.fullCommentLines;
+    m.lines_with_comment = result.linesWComment;
+    m.lines_without_comment = result.linesWOComment;
+    m.directive_lines = result.dirLines;
+    m.unique_operators = result.uniqueOperators.size();
+    m.total_operators = result.totalOperators;
+    m.unique_operands = result.uniqueOperands.size();
+    m.total_operands = result.totalOperands;
+    m.cyclomatic = result.cyclomatic;
+    m.volume = result.volume;
+    m.difficulty = result.difficulty;
+    m.effort = result.effort;
+    const double values[AEC_METRIC_COUNT] = {double(m.total_lines), double(m.blank_lines), double(m.comment_lines),
+        double(m.lines_with_comment), double(m.lines_without_comment), double(m.directive_lines),
+        double(m.unique_operators), double(m.total_operators), double(m.unique_operands), double(m.total_operands),
+        double(m.cyclomatic), m.volume, m.difficulty, m.effort};
+    std::copy(values, values + AEC_METRIC_COUNT, out->values);
+
+    // Lines each register is used at, sorted
+    for (auto& used : result.registerUse)
+    {
+        out->lines.emplace_back(used.begin(), used.end());
+        std::sort(out->lines.back().begin(), out->lines.back().end());
+    }
+    for (auto& lines : out->lines)
+    {
+        out->linePointers.push_back(lines.data());
+        out->lineCounts.push_back(lines.size());
+    }
+    out->register_count = out->lines.size();
+    out->register_lines = out->linePointers.data();
+    out->register_line_counts = out->lineCounts.data();
+
+    for (auto& function : result.functions) out->names.push_back(function.name);
+    for (size_t i = 0; i < result.functions.size(); i++)
+    {
+        const FunctionMetrics& function = result.functions[i];
+        out->functionList.push_back({out->names[i].c_str(), function.line, function.uniqueOperatorCount,
+            function.totalOperators, function.uniqueOperandCount, function.totalOperands, function.cyclomatic,
+            function.volume, function.difficulty, function.effort});
+    }
+    out->function_count = out->functionList.size();
+    out->functions = out->functionList.data();
+
+    std::vector<int> rules;
+    forEachError(result, [&](int rule, const std::string& message)
+    {
+        out->messages.push_back(message);
+        rules.push_back(rule);
+    });
+    for (size_t i = 0; i < rules.size(); i++)
+    {
+        out->list.push_back({rules[i], ruleNames[rules[i]], out->messages[i].c_str()});
+    }
+    out->error_count = out->list.size();
+    out->errors = out->list.data();
+    return out;
+}
+
+aec_result* aec_analyze(const char* name, const char* text, size_t size, const aec_options* given) {
+    AnalysisOptions options;
+    AecResult* failed = aecOptions(given, options);
+    if (failed != nullptr) return failed;
+    return aecResult(name != nullptr ? name : "", std::string(text != nullptr ? text : "", text != nullptr ? size : 0), options);
+}
+
+aec_batch* aec_analyze_files(const char* const* paths, size_t count, const aec_options* given) {
+    AecBatch* batch = new AecBatch();
+    AnalysisOptions options;
+    AecResult* failed = aecOptions(given, options);
+
+    batch->list.resize(count);
+    batch->values.resize(count * AEC_METRIC_COUNT);
+    parallelFor(count, [&](size_t i)
+    {
+        std::ifstream file(paths[i], std::ios::binary);
+        AecResult* out;
+        if (failed != nullptr)
+        {
+            out = new AecResult();
+            out->status = AEC_FAILED;
+            out->text = failed->text;
+        }
+        else if (!file.is_open())
+        {
+            out = new AecResult();
+            out->status = AEC_FAILED;
+            out->text = std::string("Error: Failed to open file: ") + paths[i];
+        }
+        else
+        {
+            std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            out = aecResult(paths[i], contents, options);
+        }
+        if (out->status == AEC_FAILED) out->message = out->text.c_str();
+        std::copy(out->values, out->values + AEC_METRIC_COUNT, batch->values.begin() + i * AEC_METRIC_COUNT);
+        batch->list[i] = out;
+    });
+    delete failed;
+
+    batch->count = count;
+    batch->results = batch->list.data();
+    batch->metric_values = batch->values.data();
+    return batch;
+}
+
+void aec_free(aec_result* result) {
+    delete static_cast<AecResult*>(result);
+}
+
+void aec_free_batch(aec_batch* batch) {
+    if (batch == nullptr) return;
+    for (aec_result* result : static_cast<AecBatch*>(batch)->list) aec_free(result);
+    delete static_cast<AecBatch*>(batch);
+}
+
+#ifdef AEC_FUZZ     // libFuzzer target, needs AEC_LIBRARY as libFuzzer has its own main
+/***************************************************************************
+ * Fuzzing the analysis. The target runs a file through the same paths
+ * as the commands, in memory: the precheck, the full analysis with
+ * every output and streaming, and the language server's incremental
+ * analysis. Built with clang's libFuzzer and the sanitizers:
+ *
+ *     clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -DAEC_LIBRARY -DAEC_FUZZ AEC.cpp -o aec_fuzz
+ *     mkdir corpus && ./aec_fuzz -max_len=4096 corpus
+ *
+ * With -DAEC_FUZZ_IR too the target is the binary IR reader instead, see
+ * below, and the corpus folder should be a new one.
+ *
+ * An empty corpus folder is given the seeds below first. The CLI itself
+ * can be built with the same sanitizers to run a -t batch under them:
+ *
+ *     g++ -std=c++17 -g -O1 -fsanitize=address,undefined -fno-omit-frame-pointer AEC.cpp -o aec_asan -pthread
+ */
+static const char* const fuzzSeeds[] = {
+    ".global main\n.text\nmain:\n    ldr r0, =msg\n    ldr r1, [r0]\n    ldr r2, [r0, #4]\n    ldr r3, [r0, #4]!\n"
+    "    ldr r3, [r0], #4\n    str r3, [r0, r1, lsl #2]\n    ldr r4, [pc, #8]\n    ldr r5, msg\n    ldrd r4, r5, [r0]\n"
+    "    mov r7, #1\n    svc 0\n.data\nmsg: .asciz \"hi\\n\"\n",
+    ".global main\n.text\nmain:\n    push {r4, lr}\n    mov r0, #3\n    bl fact\n    pop {r4, pc}\nfact:\n    cmp r0, #1\n"
+    "    ble done\n    push {r0, lr}\n    sub r0, r0, #1\n    bl fact\n    pop {r1, lr}\n    mul r0, r1, r0\ndone:\n    bx lr\n.data\nx: .word 1\n",
+    ".global _start\n.text\n_start:\n    stp x29, x30, [sp, #-16]!\n    ldr x0, =msg\n    ldr x1, [x0, x2, lsl #3]\n"
+    "    ldp x29, x30, [sp], #16\n    b.eq _start\n    mov x8, #93\n    svc 0\n.data\nmsg: .ascii \"a\"\n",
+    ".syntax unified\n.thumb\n.global main\n.text\nmain:\n    cbz r0, out\n    it eq\n    moveq r1, #1\nout:\n"
+    "    bx lr\n.data\nv: .word 0\n",
+    ".macro inc reg\n    add \\reg, \\reg, #1\n.endm\n.equ SIZE, 4\n.global main\n.text\nmain:\n.rept 2\n    inc r0\n.endr\n"
+    ".if SIZE > 2\n    ldr r1, [r0, #SIZE]\n.else\n    ldr r1, [r0]\n.endif\n    mov r7, #1\n    svc 0\n.data\n",
+    ".data\n.global main\n.text\nmain: ldr r0, [r1\n    ldr r2\n    str ,\n    b\n    .\n:\n@\n/\n[\n]!\n{\n,\n=\n#\n"};
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    for (int i = 1; i < *argc; i++)
+    {
+        std::error_code error;
+        std::string folder = (*argv)[i];
+        if (folder[0] == '-' || !std::filesystem::is_directory(folder, error) || !std::filesystem::is_empty(folder, error)) continue;
+        for (size_t seed = 0; seed < sizeof(fuzzSeeds) / sizeof(fuzzSeeds[0]); seed++)
+        {
+            for (char isa = 0; isa < 4; isa++)
+            {
+#ifdef AEC_FUZZ_IR
+                AnalysisOptions options;
+                FileAnalysis result;
+                const std::string contents = fuzzSeeds[seed];
+                options.isa = IsaProfile(isa);
+                options.outputs = OUTPUT_ALL | OUTPUT_FUNCTIONS | OUTPUT_IR | OUTPUT_IR_TEXT;
+                if (analyzeFile("/nonexistent/fuzz.s", result, options, &contents))
                 {
-                    outfile << "\t" << line << "\n";
+                    writeIr(result, folder + "/seed" + std::to_string(seed) + "_" + std::to_string(int(isa)) + ".aecir");
                 }
-                outfile << "********************************************************\n";
-                outfile.close();
+#else
+                std::ofstream(folder + "/seed" + std::to_string(seed) + "_" + std::to_string(int(isa)), std::ios::binary)
+                    << isa << fuzzSeeds[seed];
+#endif
+            }
+        }
+        break;
+    }
+    return 0;
+}
 
+#ifndef AEC_FUZZ_IR
+/***************************************************************************
+ * The first byte picks the instruction set and streaming, the rest is
+ * the file. Includes are only read from a folder that can't exist. */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size == 0) return 0;
+    const std::string name = "/nonexistent/fuzz.s";
+    const std::string contents(reinterpret_cast<const char*>(data) + 1, size - 1);
+    AnalysisOptions options;
+    options.isa = IsaProfile(data[0] & 3);
+    options.outputs = OUTPUT_ALL | OUTPUT_FUNCTIONS | OUTPUT_SIMILARITY;
+    compileOperators(options.rules);
 
-                std::cout << "Created report file: " << output_file << "\n";
-            }
-            break;
+    FileAnalysis gate, result;
+    std::ostringstream out;
+    result.streamBudget = data[0] & 4 ? 4 : 0;     // Like fileReader, streaming is set on the result
+    result.streamOut = &out;
+    precheckFile(name, gate, &contents);
+    if (analyzeFile(name, result, options, &contents))
+    {
+        finishAnalysis(result, nullptr);
+        writeErrors(result, out, true);
+        writeFunctions(result, out);
+        forEachError(result, [](int, const std::string& message) { errorLine(message); });
     }
 
-    infile.close(); // Make sure to always close file before exiting
-} 
+    IncrementalAnalysis cache;
+    FileAnalysis incremental;
+    options.outputs = OUTPUT_DIAGNOSTICS;
+    analyzeIncremental(name, contents, cache, incremental, options);
+    return 0;
+}
+#else
+/***************************************************************************
+ * Fuzzing the binary IR, built with -DAEC_FUZZ_IR as well. The bytes are
+ * written to a .aecir file, which is opened and analyzed like any other
+ * IR. The seeds are the IR of the files above. */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static const std::string path = (std::filesystem::temp_directory_path() / ("aec_fuzz_" + std::to_string(getpid()) + ".aecir")).string();
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char*>(data), size);
+
+    IrFile ir;
+    FileAnalysis result;
+    std::ostringstream out;
+    if (openIr(path, ir) && loadIr(ir, result))
+    {
+        result.outputs = OUTPUT_ALL | OUTPUT_FUNCTIONS;
+        finishAnalysis(result, nullptr);
+        writeErrors(result, out, true);
+        writeFunctions(result, out);
+    }
+    return 0;
+}
+#endif
+#endif
@@ -0,0 +1,111 @@
+/*  AEC - Assembly Error Checker - C interface
+
+    AEC.cpp can be built as a library instead of an executable, so a program
+    can analyze files in its own process:
+
+        g++ -std=c++17 -O2 -fPIC -DAEC_LIBRARY -c AEC.cpp -o AEC.o
+        ar rcs libaec.a AEC.o                      (static)
+        g++ -shared AEC.o -o libaec.so -pthread    (shared)
+
+    With AEC_LIBRARY defined there is no main. Every function below is
+    reentrant and can be called from many threads at once. Nothing is
+    printed and the process is never exited; a failure is returned in the
+    status of the result, and what the preprocessor reports, like an
+    included file that can't be opened, in its message.
+*/
+#ifndef AEC_H
+#define AEC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Instruction set of the file, AEC_ISA_DETECT reads it from the directives */
+enum aec_isa { AEC_ISA_DETECT = 0, AEC_ISA_ARM32, AEC_ISA_THUMB, AEC_ISA_AARCH64 };
+
+enum aec_status
+{
+    AEC_OK = 0,             /* The file was analyzed */
+    AEC_CATASTROPHIC = 1,   /* A catastrophic error, given in message, stopped the analysis */
+    AEC_FAILED = -1         /* Bad options or rules file, given in message */
+};
+
+/* Options of a call, all zero is detect the instruction set with every rule on */
+typedef struct aec_options
+{
+    int isa;                    /* An aec_isa */
+    const char* rules_file;     /* Rules file like --rules=, or NULL */
+} aec_options;
+
+/* One error found, rule is its index in the rule names of AEC -h */
+typedef struct aec_error
+{
+    int rule;
+    const char* rule_name;
+    const char* message;
+} aec_error;
+
+/* Line counts, Halstead's and cyclomatic complexity. metric_values of a
+   result holds the same fields as doubles, in this order. */
+#define AEC_METRIC_COUNT 14
+typedef struct aec_metrics
+{
+    int total_lines, blank_lines, comment_lines, lines_with_comment, lines_without_comment, directive_lines;
+    int unique_operators, total_operators, unique_operands, total_operands;
+    int cyclomatic;
+    double volume, difficulty, effort;
+} aec_metrics;
+
+/* Halstead's and cyclomatic complexity of one subroutine. Labels inside a
+   subroutine are counted as part of it. name is empty for code before the
+   first label. */
+typedef struct aec_function
+{
+    const char* name;
+    int line;                   /* Line of its label */
+    int unique_operators, total_operators, unique_operands, total_operands;
+    int cyclomatic;
+    double volume, difficulty, effort;
+} aec_function;
+
+typedef struct aec_result
+{
+    int status;                 /* An aec_status */
+    const char* message;        /* Why the status is not AEC_OK, or with AEC_OK what couldn't be
+                                   expanded, one line each; NULL if there is nothing to say */
+    aec_metrics metrics;
+    size_t error_count;
+    const aec_error* errors;
+    const double* metric_values;            /* AEC_METRIC_COUNT values */
+    size_t register_count;
+    const int* const* register_lines;       /* Sorted lines each register is used at */
+    const size_t* register_line_counts;
+    size_t function_count;
+    const aec_function* functions;          /* In the order they are in the file */
+} aec_result;
+
+/* Results of many files, metric_values holds count rows of AEC_METRIC_COUNT */
+typedef struct aec_batch
+{
+    size_t count;
+    aec_result* const* results;
+    const double* metric_values;
+} aec_batch;
+
+/* Analyzes size bytes of assembly text. name is only used in messages.
+   The result is owned by the caller and freed with aec_free. */
+aec_result* aec_analyze(const char* name, const char* text, size_t size, const aec_options* options);
+void aec_free(aec_result* result);
+
+/* Reads and analyzes count files on every core. A file that can't be read
+   gets an AEC_FAILED result. Freed with aec_free_batch. */
+aec_batch* aec_analyze_files(const char* const* paths, size_t count, const aec_options* options);
+void aec_free_batch(aec_batch* batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+"""AEC - Assembly Error Checker - Python module
+
+Calls libaec (see AEC.h) in process. Arrays are views of the memory of the
+result, nothing is copied: NumPy arrays when NumPy is installed, memoryviews
+otherwise. A result stays valid until it is garbage collected.
+
+    import aec
+    result = aec.analyze("lab1.s")
+    result.metrics              # AEC_METRIC_COUNT values, in METRICS order
+    result.register_lines(0)    # Lines r0 is used at
+    result.functions            # (name, line, {metric: value}) of each subroutine
+    batch = aec.analyze_files(paths)
+    batch.metrics               # One row of metrics per file
+
+ctypes lets go of the GIL while libaec runs, so analyze_files reads and
+analyzes every file on all cores while other Python threads keep running.
+The library is found with the AEC_LIBRARY environment variable, or as
+libaec.so next to this file.
+"""
+import ctypes
+import os
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+METRICS = ("total_lines", "blank_lines", "comment_lines", "lines_with_comment", "lines_without_comment",
+           "directive_lines", "unique_operators", "total_operators", "unique_operands", "total_operands",
+           "cyclomatic", "volume", "difficulty", "effort")
+FUNCTION_METRICS = ("unique_operators", "total_operators", "unique_operands", "total_operands", "cyclomatic",
+                    "volume", "difficulty", "effort")
+ISAS = {None: 0, "arm32": 1, "thumb": 2, "aarch64": 3}
+OK, CATASTROPHIC, FAILED = 0, 1, -1
+
+
+class _Options(ctypes.Structure):
+    _fields_ = [("isa", ctypes.c_int), ("rules_file", ctypes.c_char_p)]
+
+
+class _Error(ctypes.Structure):
+    _fields_ = [("rule", ctypes.c_int), ("rule_name", ctypes.c_char_p), ("message", ctypes.c_char_p)]
+
+
+class _Metrics(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_int) for name in METRICS[:11]] + [(name, ctypes.c_double) for name in METRICS[11:]]
+
+
+class _Function(ctypes.Structure):
+    _fields_ = [("name", ctypes.c_char_p), ("line", ctypes.c_int)] + \
+        [(name, ctypes.c_int) for name in FUNCTION_METRICS[:5]] + [(name, ctypes.c_double) for name in FUNCTION_METRICS[5:]]
+
+
+class _Result(ctypes.Structure):
+    _fields_ = [("status", ctypes.c_int), ("message", ctypes.c_char_p), ("metrics", _Metrics),
+                ("error_count", ctypes.c_size_t), ("errors", ctypes.POINTER(_Error)),
+                ("metric_values", ctypes.POINTER(ctypes.c_double)), ("register_count", ctypes.c_size_t),
+                ("register_lines", ctypes.POINTER(ctypes.POINTER(ctypes.c_int))),
+                ("register_line_counts", ctypes.POINTER(ctypes.c_size_t)),
+                ("function_count", ctypes.c_size_t), ("functions", ctypes.POINTER(_Function))]
+
+
+class _Batch(ctypes.Structure):
+    _fields_ = [("count", ctypes.c_size_t), ("results", ctypes.POINTER(ctypes.POINTER(_Result))),
+                ("metric_values", ctypes.POINTER(ctypes.c_double))]
+
+
+_library = ctypes.CDLL(os.environ.get("AEC_LIBRARY", os.path.join(os.path.dirname(os.path.abspath(__file__)), "libaec.so")))
+_library.aec_analyze.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(_Options)]
+_library.aec_analyze.restype = ctypes.POINTER(_Result)
+_library.aec_free.argtypes = [ctypes.POINTER(_Result)]
+_library.aec_analyze_files.argtypes = [ctypes.POINTER(ctypes.c_char_p), ctypes.c_size_t, ctypes.POINTER(_Options)]
+_library.aec_analyze_files.restype = ctypes.POINTER(_Batch)
+_library.aec_free_batch.argtypes = [ctypes.POINTER(_Batch)]
+
+
+_formats = {ctypes.c_double: "d", ctypes.c_int: "i"}
+
+
+def _view(pointer, shape, owner):
+    """An array over memory libaec owns. owner is kept alive by the view."""
+    count = 1
+    for size in shape:
+        count *= size
+    if count == 0 or not pointer:
+        return numpy.zeros(shape, pointer._type_) if numpy else memoryview(b"").cast(_formats[pointer._type_])
+    array = ctypes.cast(pointer, ctypes.POINTER(pointer._type_ * count)).contents
+    array._owner = owner
+    if numpy:
+        return numpy.ctypeslib.as_array(array).reshape(shape)
+    return memoryview(array).cast("B").cast(_formats[pointer._type_], shape)
+
+
+def _options(isa, rules):
+    return _Options(ISAS[isa], rules.encode() if rules else None)
+
+
+class Result:
+    """The analysis of one file."""
+
+    def __init__(self, pointer, owner=None):
+        self._pointer = pointer
+        self._owner = owner     # A batch frees its own results
+        result = pointer.contents
+        self.status = result.status
+        self.message = result.message.decode() if result.message else None
+        self.errors = [(error.rule_name.decode(), error.message.decode())
+                       for error in result.errors[:result.error_count]]
+        self.metrics = _view(result.metric_values, (len(METRICS),), self)
+        self.functions = [(function.name.decode(), function.line, {name: getattr(function, name) for name in FUNCTION_METRICS})
+                          for function in result.functions[:result.function_count]]
+
+    def metric(self, name):
+        return self.metrics[METRICS.index(name)]
+
+    def register_lines(self, register):
+        result = self._pointer.contents
+        if register >= result.register_count:
+            raise IndexError(register)
+        return _view(result.register_lines[register], (result.register_line_counts[register],), self)
+
+    def __del__(self):
+        if self._owner is None and self._pointer:
+            _library.aec_free(self._pointer)
+            self._pointer = None
+
+
+class Batch:
+    """The analysis of many files, metrics has one row per file."""
+
+    def __init__(self, pointer):
+        self._pointer = pointer
+        batch = pointer.contents
+        self.results = [Result(batch.results[i], self) for i in range(batch.count)]
+        self.metrics = _view(batch.metric_values, (batch.count, len(METRICS)), self)
+
+    def __del__(self):
+        if self._pointer:
+            _library.aec_free_batch(self._pointer)
+            self._pointer = None
+
+
+def analyze(path=None, text=None, isa=None, rules=None):
+    """Analyzes a file, or the given text. isa is arm32, thumb or aarch64,
+    detected from the directives if not given. rules is a rules file."""
+    if text is None:
+        with open(path, "rb") as file:
+            text = file.read()
+    elif isinstance(text, str):
+        text = text.encode()
+    name = (path or "<text>").encode()
+    return Result(_library.aec_analyze(name, text, len(text), ctypes.byref(_options(isa, rules))))
+
+
+def analyze_files(paths, isa=None, rules=None):
+    """Reads and analyzes many files on every core."""
+    names = (ctypes.c_char_p * len(paths))(*[os.fsencode(path) for path in paths])
+    return Batch(_library.aec_analyze_files(names, len(paths), ctypes.byref(_options(isa, rules))))
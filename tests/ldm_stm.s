@@ -0,0 +1,22 @@
+@ stmfd/stmdb and ldmfd/ldm with sp! save and restore like push and pop,
+@ ldm loads its register list and ldmfd {pc} returns
+.global main
+.text
+main:
+    stmfd sp!, {r4-r6, lr}
+    ldr r0, =buf
+    ldmia r0, {r5, r6}
+    add r4, r5, r6
+    mov r0, r4
+    bl sub
+    ldmfd sp!, {r4-r6, lr}
+    mov r7, #1
+    svc 0
+sub:
+    stmdb sp!, {r4, lr}
+    ldr r1, =buf
+    ldmia r1!, {r2, r3}
+    add r0, r2, r3
+    ldmfd sp!, {r4, pc}
+.data
+buf: .word 1, 2
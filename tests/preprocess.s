@@ -0,0 +1,25 @@
+@ .equ symbols read by .rept, .if and .ifdef are used, and errors in
+@ the copies of a .rept body are reported once
+.global main
+.equ N, 3
+.equ LIMIT, 2
+.equ DEBUG, 1
+.equ UNUSED, 7
+.text
+main:
+    push {lr}
+.rept N
+    add r5, r6, r7
+    swi 0
+.endr
+.if N > LIMIT
+    mov r0, #1
+.endif
+.ifdef DEBUG
+    mov r1, #2
+.endif
+    pop {lr}
+    mov r7, #1
+    svc 0
+.data
+x: .word 1
@@ -0,0 +1,18 @@
+#!/bin/sh
+# Runs AEC -e and -m on every fixture and compares what it found with the
+# .expected file next to it. File times are left out, they change.
+#   tests/run.sh [path to AEC]
+aec=${1:-./AEC}
+dir=$(dirname "$0")
+failed=0
+for fixture in "$dir"/*.s
+do
+    expected=${fixture%.s}.expected
+    if ! { "$aec" "$fixture" -e; "$aec" "$fixture" -m; } 2>&1 | grep -v -e "File Name:" -e "Last accessed:" -e "Last modified:" |
+        diff -u "$expected" - > /dev/null
+    then
+        echo "FAILED: $fixture"
+        failed=1
+    fi
+done
+exit $failed
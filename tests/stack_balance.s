@@ -0,0 +1,23 @@
+@ Call graph depths and stack balance counted through stmfd/ldmfd
+.global main
+.text
+main:
+    stmfd sp!, {r4-r7, lr}
+    bl keep
+    bl leave
+    bl drop
+    ldmfd sp!, {r4-r7, lr}
+    mov r7, #1
+    svc 0
+keep:
+    stmfd sp!, {r4, r5, lr}
+    bl leave
+    ldmfd sp!, {r4, r5, pc}
+leave:
+    stmdb sp!, {r4-r6, lr}
+    ldmia sp!, {r4, pc}
+drop:
+    stmfd sp!, {lr}
+    ldmfd sp!, {r4, r5, pc}
+.data
+buf: .word 0